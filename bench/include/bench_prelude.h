@@ -0,0 +1,42 @@
+#ifndef BENCH_PRELUDE_H
+#define BENCH_PRELUDE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cclosure.h"
+
+/* ----- INTERNAL MACROS ----- */
+
+#define Benchmark int32_t main(void)
+
+/* Prevent the compiler from optimizing away a value or a call target. */
+#define Opaque(val) __asm__ volatile("" : "+r"(val))
+
+#define ReportBegin(name) printf("{\"benchmark\": \"%s\", \"results\": [", (name))
+
+#define ReportEnd()   \
+    do {              \
+        printf("]}\n"); \
+        exit(0);      \
+    } while (0)
+
+/* Emit one result object. Every result after the first is comma-separated. */
+#define Report(first, fmt, ...) \
+    printf("%s{" fmt "}", (first) ? "" : ", ", ##__VA_ARGS__)
+
+/* ----- INTERNAL FUNCTIONS ----- */
+
+static inline uint64_t NowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+#endif /* BENCH_PRELUDE_H */
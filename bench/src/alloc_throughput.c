@@ -0,0 +1,69 @@
+/* Measure CClosureNew/CClosureFree throughput as the number of threads grows.
+ * Each thread repeatedly creates and then frees its own set of closures.
+ * Single-threaded builds of the library only measure one thread. */
+
+#ifdef THREAD_PTHREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include "bench_prelude.h"
+
+#define NUM_CLOSURES ((size_t)4096)
+#define NUM_ROUNDS ((size_t)64)
+#define MAX_THREADS ((size_t)64)
+
+static int32_t Callback(CClosureCtx ctx) {
+    return (int32_t)(intptr_t)ctx.env;
+}
+
+static void* Worker(void* ctx) {
+    void** closures = malloc(NUM_CLOSURES * sizeof(void*));
+    for (size_t round = 0; round < NUM_ROUNDS; round++) {
+        for (size_t idx = 0; idx < NUM_CLOSURES; idx++)
+            closures[idx] = CClosureNew(Callback, (void*)(intptr_t)idx, false);
+        for (size_t idx = 0; idx < NUM_CLOSURES; idx++)
+            CClosureFree(closures[idx]);
+    }
+    free(closures);
+
+    return ctx;
+}
+
+static double PairsPerSec(size_t numThreads) {
+    uint64_t start = NowNs();
+#ifdef THREAD_PTHREADS
+    pthread_t threads[MAX_THREADS];
+    for (size_t idx = 0; idx < numThreads; idx++)
+        pthread_create(threads + idx, NULL, Worker, NULL);
+    for (size_t idx = 0; idx < numThreads; idx++)
+        pthread_join(threads[idx], NULL);
+#else
+    Worker(NULL);
+#endif
+    uint64_t elapsed = NowNs() - start;
+
+    return (double)(numThreads * NUM_ROUNDS * NUM_CLOSURES) * 1e9 /
+           (double)elapsed;
+}
+
+Benchmark {
+    size_t maxThreads = 1;
+#ifdef THREAD_PTHREADS
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    maxThreads = (cpus < 4) ? 4 : (size_t)cpus;
+    if (maxThreads > MAX_THREADS)
+        maxThreads = MAX_THREADS;
+#endif
+
+    /* Warm up so the first measurement doesn't pay for growing the bank. */
+    Worker(NULL);
+
+    ReportBegin("alloc_throughput");
+    for (size_t numThreads = 1; numThreads <= maxThreads; numThreads *= 2)
+        Report(numThreads == 1,
+               "\"threads\": %zu, \"pairs_per_sec\": %.0f", numThreads,
+               PairsPerSec(numThreads));
+
+    ReportEnd();
+}
@@ -0,0 +1,235 @@
+/* Measure closure call latency against a direct call, separating thunks that
+ * straddle a cache line from those that do not. Builds with aligned thunks
+ * should report no straddling closures. Argument-shifting closures, aggregate
+ * returns and variadic calls are measured separately. */
+
+#include <stdarg.h>
+
+#include "bench_prelude.h"
+
+/* Bytes executed from a closure's own slot, which depends on its kind. On
+ * x86_64, CClosureCtx thunks end in a jump to the exit stub of their page,
+ * while argument-shifting thunks grow with the registers they shift. */
+#ifdef __LP64__
+#define THUNK_NORM_SIZE 37
+#define ThunkArgsSize(nIntArgs) (38 + 3 * (nIntArgs))
+#define LINE_SIZE 64
+#else
+#define THUNK_NORM_SIZE 22
+#define ThunkArgsSize(nIntArgs) 0
+#define LINE_SIZE 32
+#endif
+
+#define NUM_CLOSURES ((size_t)64)
+#define NUM_ROUNDS ((size_t)100000)
+
+typedef struct Triple {
+    int64_t a;
+    int64_t b;
+    int64_t c;
+} Triple;
+
+typedef int32_t (*Fcn)(int32_t);
+typedef Triple (*AggFcn)(int32_t);
+typedef int32_t (*VarFcn)(int32_t, ...);
+
+static Fcn closures[NUM_CLOSURES] = {0};
+static Fcn straddling[NUM_CLOSURES] = {0};
+static Fcn aligned[NUM_CLOSURES] = {0};
+static Fcn shifting[NUM_CLOSURES] = {0};
+static Fcn shiftingStraddling[NUM_CLOSURES] = {0};
+static Fcn shiftingAligned[NUM_CLOSURES] = {0};
+static AggFcn aggregate[NUM_CLOSURES] = {0};
+static VarFcn variadic[NUM_CLOSURES] = {0};
+
+__attribute__((noinline)) static int32_t Direct(int32_t val) {
+    return val + 1;
+}
+
+__attribute__((noinline)) static int32_t Callback(CClosureCtx ctx,
+                                                  int32_t val) {
+    (void)ctx;
+
+    return val + 1;
+}
+
+__attribute__((noinline)) static int32_t CallbackArgs(void* env,
+                                                      int32_t val) {
+    (void)env;
+
+    return val + 1;
+}
+
+__attribute__((noinline)) static Triple DirectAgg(int32_t val) {
+    return (Triple){val + 1, val, val};
+}
+
+__attribute__((noinline)) static Triple CallbackAgg(CClosureCtx ctx,
+                                                    int32_t val) {
+    (void)ctx;
+
+    return (Triple){val + 1, val, val};
+}
+
+__attribute__((noinline)) static int32_t DirectVar(int32_t val, ...) {
+    va_list args;
+    va_start(args, val);
+    int32_t inc = va_arg(args, int32_t);
+    va_end(args);
+
+    return val + inc;
+}
+
+__attribute__((noinline)) static int32_t CallbackVar(CClosureCtx ctx,
+                                                     int32_t val,
+                                                     ...) {
+    (void)ctx;
+    va_list args;
+    va_start(args, val);
+    int32_t inc = va_arg(args, int32_t);
+    va_end(args);
+
+    return val + inc;
+}
+
+static bool Straddles(const void* clos, size_t size) {
+    return (uintptr_t)clos / LINE_SIZE !=
+           ((uintptr_t)clos + size - 1) / LINE_SIZE;
+}
+
+static double NsPerCall(Fcn* fcns, size_t num) {
+    if (num == 0)
+        return 0.0;
+
+    int32_t acc = 0;
+    uint64_t start = NowNs();
+    for (size_t round = 0; round < NUM_ROUNDS; round++) {
+        for (size_t idx = 0; idx < num; idx++) {
+            Fcn fcn = fcns[idx];
+            Opaque(fcn);
+            acc = fcn(acc);
+        }
+    }
+    uint64_t elapsed = NowNs() - start;
+    Opaque(acc);
+
+    return (double)elapsed / (double)(num * NUM_ROUNDS);
+}
+
+static double NsPerCallAgg(AggFcn* fcns, size_t num) {
+    int32_t acc = 0;
+    uint64_t start = NowNs();
+    for (size_t round = 0; round < NUM_ROUNDS; round++) {
+        for (size_t idx = 0; idx < num; idx++) {
+            AggFcn fcn = fcns[idx];
+            Opaque(fcn);
+            acc = (int32_t)fcn(acc).a;
+        }
+    }
+    uint64_t elapsed = NowNs() - start;
+    Opaque(acc);
+
+    return (double)elapsed / (double)(num * NUM_ROUNDS);
+}
+
+static double NsPerCallVar(VarFcn* fcns, size_t num) {
+    int32_t acc = 0;
+    uint64_t start = NowNs();
+    for (size_t round = 0; round < NUM_ROUNDS; round++) {
+        for (size_t idx = 0; idx < num; idx++) {
+            VarFcn fcn = fcns[idx];
+            Opaque(fcn);
+            acc = fcn(acc, 1);
+        }
+    }
+    uint64_t elapsed = NowNs() - start;
+    Opaque(acc);
+
+    return (double)elapsed / (double)(num * NUM_ROUNDS);
+}
+
+Benchmark {
+    size_t numStraddling = 0;
+    size_t numAligned = 0;
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        closures[idx] = CClosureNew(Callback, NULL, false);
+        if (Straddles(closures[idx], THUNK_NORM_SIZE))
+            straddling[numStraddling++] = closures[idx];
+        else
+            aligned[numAligned++] = closures[idx];
+    }
+
+    size_t numShiftingStraddling = 0;
+    size_t numShiftingAligned = 0;
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        shifting[idx] = CClosureNewArgs(CallbackArgs, NULL, 1);
+        if (shifting[idx] == NULL)
+            continue;
+        if (Straddles(shifting[idx], ThunkArgsSize(1)))
+            shiftingStraddling[numShiftingStraddling++] = shifting[idx];
+        else
+            shiftingAligned[numShiftingAligned++] = shifting[idx];
+    }
+
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        aggregate[idx] = CClosureNew(CallbackAgg, NULL, true);
+        variadic[idx] = CClosureNew(CallbackVar, NULL, false);
+    }
+
+    Fcn direct[NUM_CLOSURES];
+    AggFcn directAgg[NUM_CLOSURES];
+    VarFcn directVar[NUM_CLOSURES];
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        direct[idx] = Direct;
+        directAgg[idx] = DirectAgg;
+        directVar[idx] = DirectVar;
+    }
+
+    ReportBegin("call_latency");
+    Report(true, "\"case\": \"direct\", \"count\": %zu, \"ns_per_call\": %.3f",
+           NUM_CLOSURES, NsPerCall(direct, NUM_CLOSURES));
+    Report(false,
+           "\"case\": \"closure_aligned\", \"count\": %zu, "
+           "\"ns_per_call\": %.3f",
+           numAligned, NsPerCall(aligned, numAligned));
+    Report(false,
+           "\"case\": \"closure_straddling\", \"count\": %zu, "
+           "\"ns_per_call\": %.3f",
+           numStraddling, NsPerCall(straddling, numStraddling));
+    Report(false,
+           "\"case\": \"closure_args_aligned\", \"count\": %zu, "
+           "\"ns_per_call\": %.3f",
+           numShiftingAligned,
+           NsPerCall(shiftingAligned, numShiftingAligned));
+    Report(false,
+           "\"case\": \"closure_args_straddling\", \"count\": %zu, "
+           "\"ns_per_call\": %.3f",
+           numShiftingStraddling,
+           NsPerCall(shiftingStraddling, numShiftingStraddling));
+    Report(false,
+           "\"case\": \"direct_aggregate\", \"count\": %zu, "
+           "\"ns_per_call\": %.3f",
+           NUM_CLOSURES, NsPerCallAgg(directAgg, NUM_CLOSURES));
+    Report(false,
+           "\"case\": \"closure_aggregate\", \"count\": %zu, "
+           "\"ns_per_call\": %.3f",
+           NUM_CLOSURES, NsPerCallAgg(aggregate, NUM_CLOSURES));
+    Report(false,
+           "\"case\": \"direct_variadic\", \"count\": %zu, "
+           "\"ns_per_call\": %.3f",
+           NUM_CLOSURES, NsPerCallVar(directVar, NUM_CLOSURES));
+    Report(false,
+           "\"case\": \"closure_variadic\", \"count\": %zu, "
+           "\"ns_per_call\": %.3f",
+           NUM_CLOSURES, NsPerCallVar(variadic, NUM_CLOSURES));
+
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        CClosureFree(closures[idx]);
+        CClosureFree(aggregate[idx]);
+        CClosureFree(variadic[idx]);
+        if (shifting[idx] != NULL)
+            CClosureFree(shifting[idx]);
+    }
+
+    ReportEnd();
+}
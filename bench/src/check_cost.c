@@ -0,0 +1,51 @@
+/* Measure the cost of CClosureCheck as the number of live closures grows,
+ * both for closures and for addresses the library doesn't own. */
+
+#include "bench_prelude.h"
+
+#define MAX_CLOSURES ((size_t)1 << 20)
+#define NUM_LOOKUPS ((size_t)1 << 22)
+
+static void* closures[MAX_CLOSURES] = {0};
+
+static int32_t Callback(CClosureCtx ctx) {
+    return (int32_t)(intptr_t)ctx.env;
+}
+
+static double NsPerCheck(void* const* addrs, size_t num) {
+    size_t hits = 0;
+    uint64_t start = NowNs();
+    for (size_t idx = 0; idx < NUM_LOOKUPS; idx++) {
+        /* Stride through the set so lookups don't just hit one block. */
+        void* addr = addrs[(idx * 7919) & (num - 1)];
+        Opaque(addr);
+        hits += CClosureCheck(addr);
+    }
+    uint64_t elapsed = NowNs() - start;
+    Opaque(hits);
+
+    return (double)elapsed / (double)NUM_LOOKUPS;
+}
+
+Benchmark {
+    void** foreign = malloc(MAX_CLOSURES * sizeof(void*));
+    for (size_t idx = 0; idx < MAX_CLOSURES; idx++)
+        foreign[idx] = foreign + idx;
+
+    ReportBegin("check_cost");
+    size_t live = 0;
+    for (size_t num = 1024; num <= MAX_CLOSURES; num *= 4) {
+        for (; live < num; live++)
+            closures[live] = CClosureNew(Callback, NULL, false);
+        Report(num == 1024,
+               "\"closures\": %zu, \"ns_per_check\": %.3f, "
+               "\"ns_per_foreign_check\": %.3f",
+               num, NsPerCheck(closures, num), NsPerCheck(foreign, num));
+    }
+
+    for (size_t idx = 0; idx < live; idx++)
+        CClosureFree(closures[idx]);
+    free(foreign);
+
+    ReportEnd();
+}
@@ -0,0 +1,50 @@
+/* Measure how much resident memory one million closures occupy, and how much
+ * of it is given back once they are freed again. */
+
+#include <unistd.h>
+
+#include "bench_prelude.h"
+
+#define NUM_CLOSURES ((size_t)1000000)
+
+static void* closures[NUM_CLOSURES] = {0};
+
+static int32_t Callback(CClosureCtx ctx) {
+    return (int32_t)(intptr_t)ctx.env;
+}
+
+static size_t ResidentBytes(void) {
+    size_t size = 0;
+    size_t resident = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL || fscanf(statm, "%zu %zu", &size, &resident) != 2) {
+        fprintf(stderr, "Could not read /proc/self/statm!\n");
+        exit(1);
+    }
+    fclose(statm);
+
+    return resident * (size_t)getpagesize();
+}
+
+Benchmark {
+    size_t base = ResidentBytes();
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        closures[idx] = CClosureNew(Callback, (void*)(intptr_t)idx, false);
+        /* Call each closure once so that every page is actually touched. */
+        ((int32_t(*)(void))closures[idx])();
+    }
+    size_t live = ResidentBytes();
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++)
+        CClosureFree(closures[idx]);
+    size_t freed = ResidentBytes();
+
+    ReportBegin("rss_usage");
+    Report(true,
+           "\"closures\": %zu, \"rss_bytes\": %zu, "
+           "\"bytes_per_closure\": %.2f, \"rss_after_free_bytes\": %zu",
+           NUM_CLOSURES, live - base,
+           (double)(live - base) / (double)NUM_CLOSURES,
+           (freed > base) ? freed - base : 0);
+
+    ReportEnd();
+}
@@ -34,11 +34,59 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /* ----- PUBLIC MACROS ----- */
 
 #define CClosurePacked __attribute__((packed))
 
+/**
+ * @brief Maximum number of integer arguments that closures created using
+ * ::CClosureNewArgs may be called with.
+ *
+ * This is the number of integer argument registers left once the environment
+ * occupies the first. It is `0` on x86, where ::CClosureNewArgs is not
+ * supported.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureNewArgs
+ */
+#ifdef __x86_64__
+#define CCLOSURE_MAX_INT_ARGS 5
+#else
+#define CCLOSURE_MAX_INT_ARGS 0
+#endif
+
+/**
+ * @brief Maximum number of values that ::CClosureBind can bind.
+ *
+ * It is `0` on x86, where ::CClosureBind is not supported.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureBind
+ */
+#ifdef __x86_64__
+#define CCLOSURE_MAX_BIND_ARGS 3
+#else
+#define CCLOSURE_MAX_BIND_ARGS 0
+#endif
+
+/**
+ * @brief Maximum size in bytes of an environment stored inline using
+ * ::CClosureNewInline.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureNewInline
+ */
+#define CCLOSURE_MAX_INLINE_ENV 32
+
 /* ----- PUBLIC TYPES ------ */
 
 /**
@@ -88,6 +136,103 @@ typedef enum CClosureThreadType {
     CCLOSURE_THREAD_PTHREADS,
 } CClosureThreadType;
 
+/**
+ * @brief Snapshot of libcclosure's internal state, as filled in by
+ * ::CClosureGetStats.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureGetStats
+ */
+typedef struct CClosureStats {
+    /**
+     * @brief Number of closures that have been created but not yet freed.
+     *
+     * @since 1.3.0
+     */
+    size_t liveClosures;
+    /**
+     * @brief Number of memory blocks closures are allocated from.
+     *
+     * @since 1.3.0
+     */
+    size_t numBlocks;
+    /**
+     * @brief Number of memory blocks that have not been given back to the
+     * kernel.
+     *
+     * @since 1.3.0
+     */
+    size_t committedBlocks;
+    /**
+     * @brief Bytes of address space mapped for all memory blocks.
+     *
+     * @since 1.3.0
+     */
+    size_t mappedBytes;
+    /**
+     * @brief Bytes of address space mapped for committed memory blocks.
+     *
+     * @since 1.3.0
+     */
+    size_t committedBytes;
+    /**
+     * @brief Total number of closures ever created.
+     *
+     * @since 1.3.0
+     */
+    uint64_t numCreated;
+    /**
+     * @brief Total number of closures ever freed.
+     *
+     * @since 1.3.0
+     */
+    uint64_t numFreed;
+    /**
+     * @brief Number of times creating closures required adding or recommitting
+     * a memory block.
+     *
+     * @since 1.3.0
+     */
+    uint64_t numGrows;
+    /**
+     * @brief Number of times a thread found the shared memory block lock
+     * already held and had to wait for it.
+     *
+     * Always `0` when libcclosure was compiled without multi-threading support.
+     *
+     * @since 1.3.0
+     */
+    uint64_t lockContended;
+    /**
+     * @brief Total nanoseconds threads spent waiting for the shared memory
+     * block lock.
+     *
+     * Always `0` when libcclosure was compiled without multi-threading support.
+     *
+     * @since 1.3.0
+     */
+    uint64_t lockWaitNs;
+} CClosureStats;
+
+/**
+ * @brief Group of closures that are all destroyed together.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureArenaCreate
+ */
+typedef struct CClosureArena CClosureArena;
+
+/**
+ * @brief Group of closures that are created and destroyed by a single thread.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosurePoolCreate
+ */
+typedef struct CClosurePool CClosurePool;
+
 /* ----- PUBLIC CONSTANTS ----- */
 
 /**
@@ -135,8 +280,19 @@ void* CClosureNew(void* fcn, void* env, bool aggRet);
  * While this function is thread-safe in the majority of cases, **it is
  * not thread-safe and may result in undefined behavior** if it is called
  * while argument `clos`:
- * - is being called with or gets passed to ::CClosureGetFcn,
- * - or is being called with or gets passed to ::CClosureGetEnv.
+ * - gets passed to ::CClosureSetFcn,
+ * - or gets passed to ::CClosureSetEnv.
+ *
+ * Passing argument `clos` to ::CClosureGetFcn or ::CClosureGetEnv at the same
+ * time is safe. A freed slot is not reused until every such call that could
+ * have observed it has returned, but calls made after that may see whatever
+ * took its place.
+ *
+ * That guarantee only covers this function and ::CClosureFreeBatch.
+ * ::CClosurePoolFree reuses slots right away, and ::CClosureArenaDestroy and
+ * ::CClosurePoolDestroy give their blocks back right away, so closures going
+ * through them must not be passed to ::CClosureGetFcn or ::CClosureGetEnv at
+ * the same time either.
  *
  * @param[in] clos Closure to destroy.
  *
@@ -148,6 +304,320 @@ void* CClosureNew(void* fcn, void* env, bool aggRet);
  */
 void* CClosureFree(void* clos);
 
+/**
+ * @brief Create a new closure that passes its environment as a plain leading
+ * argument.
+ *
+ * Unlike ::CClosureNew, the resulting closure does not build a CClosureCtx.
+ * It shifts the integer arguments it was called with up by one register,
+ * loads argument `env` into the first, and jumps straight to argument `fcn`.
+ * This makes a call through it cost about the same as a direct call.
+ *
+ * @remark This function is completely thread-safe.
+ * @remark Argument `fcn` must return a scalar, and the closure must be called
+ * with no more than argument `nIntArgs` integer or pointer arguments.
+ * Floating-point arguments are passed through untouched and do not count.
+ * @remark This function is only supported on x86_64. On x86 it always returns
+ * `NULL`.
+ *
+ * @param[in] fcn Pointer to the function to bind to. Its first parameter *must*
+ * be of type `void*`.
+ * @param[in] env Environment to bind to. May be `NULL`.
+ * @param[in] nIntArgs Number of integer or pointer arguments the closure will
+ * be called with. At most ::CCLOSURE_MAX_INT_ARGS.
+ *
+ * @return Pointer to newly bound closure. It will have the same signature as
+ * argument `fcn` but without the first environment parameter. It should later
+ * be destroyed using ::CClosureFree. Returns `NULL` if argument `nIntArgs`
+ * exceeds ::CCLOSURE_MAX_INT_ARGS.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureNew
+ * @sa CClosureFree
+ */
+void* CClosureNewArgs(void* fcn, void* env, size_t nIntArgs);
+
+/**
+ * @brief Create a new closure that passes several fixed values as plain
+ * leading arguments.
+ *
+ * Like ::CClosureNewArgs, the resulting closure does not build a CClosureCtx.
+ * Its machine code holds the values themselves, so a call through it shifts
+ * the integer arguments it was called with up by argument `n` registers, loads
+ * the values into the first ones, and jumps straight to argument `fcn` without
+ * reading any environment from memory.
+ *
+ * @remark This function is completely thread-safe.
+ * @remark Argument `fcn` must return a scalar, and the closure must be called
+ * with no more than `CCLOSURE_MAX_INT_ARGS + 1 - n` integer or pointer
+ * arguments. Floating-point arguments are passed through untouched and do not
+ * count.
+ * @remark The first value is treated as the closure's environment: it is what
+ * ::CClosureGetEnv and ::CClosureFree return, and what ::CClosureSetEnv
+ * replaces. The others cannot be changed once bound.
+ * @remark This function is only supported on x86_64. On x86 it always returns
+ * `NULL`.
+ *
+ * @param[in] fcn Pointer to the function to bind to. Its first argument `n`
+ * parameters *must* be integers or pointers.
+ * @param[in] n Number of values to bind. At least `1` and at most
+ * ::CCLOSURE_MAX_BIND_ARGS.
+ * @param[in] values Values to bind, in parameter order.
+ *
+ * @return Pointer to newly bound closure. It will have the same signature as
+ * argument `fcn` but without the first argument `n` parameters. It should later
+ * be destroyed using ::CClosureFree. Returns `NULL` if argument `n` is out of
+ * range.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureNewArgs
+ * @sa CClosureFree
+ */
+void* CClosureBind(void* fcn, size_t n, const uintptr_t* values);
+
+/**
+ * @brief Create a new closure that keeps its own copy of a small environment.
+ *
+ * Behaves like ::CClosureNew, except that the `size` bytes at argument `env`
+ * are copied into storage belonging to the closure, and CClosureCtx::env
+ * points to that copy. This spares allocating and freeing a separate
+ * environment for every closure.
+ *
+ * @remark This function is completely thread-safe.
+ * @remark The copy is aligned suitably for any type, may be modified through
+ * CClosureCtx::env, and is released along with the closure. The environment
+ * ::CClosureFree returns for such a closure must therefore not be used.
+ *
+ * @param[in] fcn Pointer to the function to bind to. See ::CClosureNew.
+ * @param[in] env Environment to copy. May be `NULL` if argument `size` is
+ * `0`.
+ * @param[in] size Size of argument `env` in bytes. At most
+ * ::CCLOSURE_MAX_INLINE_ENV.
+ * @param[in] aggRet Wether the return type of argument `fcn` is an aggregate
+ * (`true`) or a scalar (`false`).
+ *
+ * @return Pointer to newly bound closure, which should later be destroyed
+ * using ::CClosureFree. Returns `NULL` if argument `size` exceeds
+ * ::CCLOSURE_MAX_INLINE_ENV.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureNew
+ * @sa CClosureFree
+ */
+void* CClosureNewInline(void* fcn, const void* env, size_t size, bool aggRet);
+
+/**
+ * @brief Create several closures at once.
+ *
+ * Equivalent to calling ::CClosureNew once per element, but free slots are
+ * claimed from the shared pool in bulk so that locking costs are paid once
+ * per batch rather than once per closure.
+ *
+ * @remark This function is completely thread-safe.
+ *
+ * @param[in] fcns Array of `num` functions to bind to. See ::CClosureNew.
+ * @param[in] envs Array of `num` environments to bind to. May be `NULL`, in
+ * which case every closure is bound to a `NULL` environment.
+ * @param[in] aggRets Array of `num` aggregate return flags. May be `NULL`, in
+ * which case every function is assumed to return a scalar.
+ * @param[out] out Array receiving the `num` newly bound closures.
+ * @param[in] num Number of closures to create.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureNew
+ * @sa CClosureFreeBatch
+ */
+void CClosureNewBatch(void* const* fcns,
+                      void* const* envs,
+                      const bool* aggRets,
+                      void** out,
+                      size_t num);
+
+/**
+ * @brief Destroy several closures at once.
+ *
+ * Equivalent to calling ::CClosureFree once per element, but freed slots are
+ * returned to the shared pool in bulk.
+ *
+ * @remark The thread-safety caveats of ::CClosureFree apply to every element
+ * of argument `closures`.
+ *
+ * @param[in] closures Array of `num` closures to destroy.
+ * @param[out] envsOut Array receiving the `num` environments previously bound
+ * to the closures. May be `NULL`.
+ * @param[in] num Number of closures to destroy.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureFree
+ * @sa CClosureNewBatch
+ */
+void CClosureFreeBatch(void* const* closures, void** envsOut, size_t num);
+
+/**
+ * @brief Make sure that a number of free slots exist ahead of time.
+ *
+ * Creating closures occasionally has to map and format a new block of
+ * memory, holding up every other thread creating closures meanwhile. Calling
+ * this function at startup or before a known burst moves that cost out of
+ * the way. The reserved slots are also kept from being given back to the
+ * kernel when closures are destroyed.
+ *
+ * @remark This function is completely thread-safe.
+ * @remark Each call replaces the previous reservation. Pass `0` to drop it.
+ *
+ * @param[in] num Minimum number of free slots to keep available.
+ *
+ * @return `false` if argument `num` is more than physical memory could hold,
+ * in which case the previous reservation is kept, otherwise `true`.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureNew
+ */
+bool CClosureReserve(size_t num);
+
+/**
+ * @brief Create an empty closure arena.
+ *
+ * Closures created using ::CClosureArenaNew take the next slot of a memory
+ * block reserved for the arena, and are all destroyed at once by
+ * ::CClosureArenaDestroy. This suits closures sharing a lifetime, such as the
+ * callbacks of one request.
+ *
+ * @remark This function is completely thread-safe. The arena it returns is
+ * not, and must not be used by several threads at the same time.
+ *
+ * @return Pointer to the new arena. It should later be destroyed using
+ * ::CClosureArenaDestroy.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureArenaNew
+ * @sa CClosureArenaDestroy
+ */
+CClosureArena* CClosureArenaCreate(void);
+
+/**
+ * @brief Create a new closure owned by an arena.
+ *
+ * Behaves like ::CClosureNew, except that the closure is destroyed along with
+ * argument `arena`. It **must not** be passed to ::CClosureFree or
+ * ::CClosureFreeBatch.
+ *
+ * @param[in] arena Arena to create the closure in.
+ * @param[in] fcn Pointer to the function to bind to. See ::CClosureNew.
+ * @param[in] env Environment to bind to. May be `NULL`.
+ * @param[in] aggRet Wether the return type of argument `fcn` is an aggregate
+ * (`true`) or a scalar (`false`).
+ *
+ * @return Pointer to newly bound closure.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureArenaCreate
+ * @sa CClosureArenaDestroy
+ */
+void* CClosureArenaNew(CClosureArena* arena, void* fcn, void* env, bool aggRet);
+
+/**
+ * @brief Destroy an arena along with every closure created in it.
+ *
+ * The cost of this function depends on the number of memory blocks the arena
+ * spans, which grow geometrically, rather than on its number of closures.
+ *
+ * @remark None of the arena's closures may be executing, be queried at the
+ * same time, or be called afterwards. The environments bound to them are not
+ * returned.
+ *
+ * @param[in] arena Arena to destroy.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureArenaCreate
+ */
+void CClosureArenaDestroy(CClosureArena* arena);
+
+/**
+ * @brief Create a new pool of closures owned by the calling thread.
+ *
+ * A pool hands out slots from memory blocks it owns exclusively, and keeps
+ * freed slots for its own reuse. Creating and destroying its closures thus
+ * takes no locks, except when the pool needs another block. Unlike an arena,
+ * its closures may be destroyed one by one.
+ *
+ * @remark This function is completely thread-safe. The pool it returns is
+ * not, and must only be used by the thread that created it. Its closures may
+ * still be called from any thread.
+ *
+ * @return Pointer to the new pool.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosurePoolNew
+ * @sa CClosurePoolFree
+ * @sa CClosurePoolDestroy
+ */
+CClosurePool* CClosurePoolCreate(void);
+
+/**
+ * @brief Create a new closure owned by a pool.
+ *
+ * Behaves like ::CClosureNew, except that the closure **must** be destroyed
+ * using ::CClosurePoolFree on the same pool, or along with the pool.
+ *
+ * @param[in] pool Pool to create the closure in.
+ * @param[in] fcn Pointer to the function to bind to. See ::CClosureNew.
+ * @param[in] env Environment to bind to. May be `NULL`.
+ * @param[in] aggRet Wether the return type of argument `fcn` is an aggregate
+ * (`true`) or a scalar (`false`).
+ *
+ * @return Pointer to newly bound closure.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosurePoolFree
+ */
+void* CClosurePoolNew(CClosurePool* pool, void* fcn, void* env, bool aggRet);
+
+/**
+ * @brief Destroy a closure previously created using ::CClosurePoolNew.
+ *
+ * @remark Freed slots are reused by the pool right away, so argument `clos`
+ * must not be passed to ::CClosureGetFcn, ::CClosureGetEnv, ::CClosureSetFcn
+ * or ::CClosureSetEnv at the same time. Like ::CClosureFree, it is safe to
+ * call on a closure that is being executed.
+ *
+ * @param[in] pool Pool argument `clos` was created in.
+ * @param[in] clos Closure to destroy.
+ *
+ * @return The environment previously bound to argument `clos`.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosurePoolNew
+ */
+void* CClosurePoolFree(CClosurePool* pool, void* clos);
+
+/**
+ * @brief Destroy a pool along with every closure still live in it.
+ *
+ * @remark None of the pool's closures may be executing, be queried at the
+ * same time, or be called afterwards. The environments bound to them are not
+ * returned.
+ *
+ * @param[in] pool Pool to destroy.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosurePoolCreate
+ */
+void CClosurePoolDestroy(CClosurePool* pool);
+
 /**
  * @brief Query whether or not a given reference points to an initialized
  * closure created using ::CClosureNew.
@@ -165,8 +635,9 @@ bool CClosureCheck(void* clos);
 /**
  * @brief Query the callback function bound to a closure.
  *
- * @remark This function is thread-safe if the situation mentioned in
- * @ref CClosureFreeWarn does not apply.
+ * @remark This function is completely thread-safe. If argument `clos` is
+ * destroyed at the same time, either the function it was last bound to, the
+ * function of a closure that has since reused its slot, or `NULL` is returned.
  *
  * @param[in] clos Closure to query.
  *
@@ -179,8 +650,10 @@ void* CClosureGetFcn(void* clos);
 /**
  * @brief Query the environment bound to a closure.
  *
- * @remark This function is thread-safe if the situation mentioned in
- * @ref CClosureFreeWarn does not apply.
+ * @remark This function is completely thread-safe. If argument `clos` is
+ * destroyed at the same time, either the environment it was last bound to,
+ * the environment of a closure that has since reused its slot, or `NULL` is
+ * returned.
  *
  * @param[in] clos Closure to query.
  *
@@ -190,4 +663,75 @@ void* CClosureGetFcn(void* clos);
  */
 void* CClosureGetEnv(void* clos);
 
+/**
+ * @brief Atomically rebind the callback function of a closure.
+ *
+ * Lets a closure be reused for a different function without destroying it,
+ * so its address stays valid.
+ *
+ * @remark This function is thread-safe if the situation mentioned in
+ * @ref CClosureFreeWarn does not apply. Threads calling argument `clos` at the
+ * same time either call the previous function or the new one, never a mix of
+ * both. A call that has already started keeps the previous function.
+ * @remark The new function must match the kind of closure: a CClosureCtx
+ * callback for closures created using ::CClosureNew (with the same `aggRet`),
+ * or a `void*` callback for closures created using ::CClosureNewArgs.
+ *
+ * @param[in] clos Closure to rebind.
+ * @param[in] fcn New callback function.
+ *
+ * @return The callback function previously bound to argument `clos`.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureSetEnv
+ */
+void* CClosureSetFcn(void* clos, void* fcn);
+
+/**
+ * @brief Atomically rebind the environment of a closure.
+ *
+ * Lets a closure be reused for a different environment without destroying
+ * it, so its address stays valid.
+ *
+ * @remark This function is thread-safe if the situation mentioned in
+ * @ref CClosureFreeWarn does not apply. Threads calling argument `clos` at the
+ * same time either see the previous environment or the new one, never a mix
+ * of both. Environment and function are rebound separately, so a call may
+ * see the new environment with the old function between calls to
+ * ::CClosureSetEnv and ::CClosureSetFcn.
+ *
+ * @param[in] clos Closure to rebind.
+ * @param[in] env New environment. May be `NULL`.
+ *
+ * @return The environment previously bound to argument `clos`.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureSetFcn
+ */
+void* CClosureSetEnv(void* clos, void* env);
+
+/**
+ * @brief Query statistics about libcclosure's memory and lock usage.
+ *
+ * Counters are kept per thread and only summed here, so keeping track of them
+ * adds next to nothing to creating and destroying closures.
+ *
+ * @remark This function is completely thread-safe. The figures it reports are
+ * not taken atomically with respect to other threads creating or destroying
+ * closures at the same time.
+ *
+ * @param[out] stats Receives the current statistics.
+ *
+ * @since 1.3.0
+ *
+ * @sa CClosureStats
+ */
+void CClosureGetStats(CClosureStats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* CCLOSURE_H */
\ No newline at end of file
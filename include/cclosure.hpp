@@ -0,0 +1,292 @@
+/**
+ * @file
+ *
+ * @brief Typed, move-only C++ wrapper around function closures.
+ *
+ * @since 1.3.0
+ *
+ * @copyright 2023 Garrett Fairburn <breadboardfox@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CCLOSURE_HPP
+#define CCLOSURE_HPP
+
+#if __cplusplus < 201703L
+#error "cclosure.hpp requires C++17 or later."
+#endif
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "cclosure.h"
+
+namespace cclosure {
+
+/* ----- PRIVATE HELPERS ----- */
+
+namespace detail {
+
+/* Both x86 ABIs return classes and unions through a hidden pointer whenever
+ * they need one, which is all the aggregate thunk has to know about. */
+template <class R>
+inline constexpr bool returnsAggregate = std::is_class_v<R> || std::is_union_v<R>;
+
+/* Callables this small live in the closure's own slot. */
+template <class F>
+inline constexpr bool fitsInline = sizeof(F) <= CCLOSURE_MAX_INLINE_ENV &&
+                                   alignof(F) <= alignof(std::max_align_t);
+
+template <class F>
+void DestroyInline(void* env) noexcept {
+    static_cast<F*>(env)->~F();
+}
+
+template <class F>
+void DestroyHeap(void* env) noexcept {
+    delete static_cast<F*>(env);
+}
+
+}  // namespace detail
+
+/* ----- PUBLIC TYPES ----- */
+
+/**
+ * @brief Owning handle to a closure with the given signature.
+ *
+ * @since 1.3.0
+ */
+template <class Signature>
+class closure;
+
+/**
+ * @brief Owning handle to a closure that can be called as a plain
+ * `R (*)(Args...)` function pointer.
+ *
+ * The closure is destroyed, along with the callable it is bound to, when the
+ * handle is destroyed. Handles can be moved but not copied. Moving one only
+ * hands the existing closure over, so the function pointer stays the same.
+ *
+ * Callables of at most ::CCLOSURE_MAX_INLINE_ENV bytes are stored in the
+ * closure itself using ::CClosureNewInline. Larger ones are allocated on the
+ * heap.
+ *
+ * @remark Creating and destroying handles is thread-safe. Calling the closure
+ * is thread-safe if the bound callable is.
+ *
+ * @since 1.3.0
+ */
+template <class R, class... Args>
+class closure<R(Args...)> {
+   public:
+    /**
+     * @brief Plain function pointer type of the closure.
+     *
+     * @since 1.3.0
+     */
+    using pointer = R (*)(Args...);
+
+    /**
+     * @brief Create an empty handle.
+     *
+     * @since 1.3.0
+     */
+    closure() noexcept = default;
+
+    /**
+     * @brief Create a closure that calls a copy of a callable.
+     *
+     * @param[in] fcn Callable to bind. It is moved into the closure if
+     * possible.
+     *
+     * @since 1.3.0
+     */
+    template <class F,
+              class = std::enable_if_t<
+                  !std::is_same_v<std::decay_t<F>, closure> &&
+                  std::is_invocable_r_v<R, std::decay_t<F>&, Args...>>>
+    explicit closure(F&& fcn) {
+        Bind<std::decay_t<F>>(std::forward<F>(fcn));
+    }
+
+    /**
+     * @brief Create a closure that calls a member function of an object.
+     *
+     * @param[in] obj Object to call argument `method` on. It must outlive the
+     * closure.
+     * @param[in] method Member function to call.
+     *
+     * @since 1.3.0
+     */
+    template <class C>
+    closure(C& obj, R (C::*method)(Args...))
+        : closure([&obj, method](Args... args) -> R {
+              return (obj.*method)(std::forward<Args>(args)...);
+          }) {}
+
+    /**
+     * @brief Create a closure that calls a const member function of an object.
+     *
+     * @param[in] obj Object to call argument `method` on. It must outlive the
+     * closure.
+     * @param[in] method Member function to call.
+     *
+     * @since 1.3.0
+     */
+    template <class C>
+    closure(const C& obj, R (C::*method)(Args...) const)
+        : closure([&obj, method](Args... args) -> R {
+              return (obj.*method)(std::forward<Args>(args)...);
+          }) {}
+
+    closure(const closure&) = delete;
+    closure& operator=(const closure&) = delete;
+
+    /**
+     * @brief Take over the closure owned by another handle, leaving it empty.
+     *
+     * @since 1.3.0
+     */
+    closure(closure&& other) noexcept
+        : fcn(std::exchange(other.fcn, nullptr)),
+          destroy(std::exchange(other.destroy, nullptr)) {}
+
+    /**
+     * @brief Destroy the owned closure, if any, and take over the closure
+     * owned by another handle, leaving it empty.
+     *
+     * @since 1.3.0
+     */
+    closure& operator=(closure&& other) noexcept {
+        if (this != &other) {
+            reset();
+            fcn = std::exchange(other.fcn, nullptr);
+            destroy = std::exchange(other.destroy, nullptr);
+        }
+
+        return *this;
+    }
+
+    ~closure() { reset(); }
+
+    /**
+     * @brief Query the closure as a plain function pointer, for instance to
+     * pass it to a C API.
+     *
+     * @return The closure, or `nullptr` if the handle is empty. It remains
+     * valid until the handle, or the handle it was moved to, is destroyed or
+     * reset.
+     *
+     * @since 1.3.0
+     */
+    pointer get() const noexcept { return fcn; }
+
+    /**
+     * @brief Query whether the handle owns a closure.
+     *
+     * @since 1.3.0
+     */
+    explicit operator bool() const noexcept { return fcn != nullptr; }
+
+    /**
+     * @brief Call the closure. The handle must not be empty.
+     *
+     * @since 1.3.0
+     */
+    R operator()(Args... args) const {
+        return fcn(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Destroy the owned closure, if any, leaving the handle empty.
+     *
+     * @remark The closure must not be executing in another thread.
+     *
+     * @since 1.3.0
+     */
+    void reset() noexcept {
+        if (fcn == nullptr)
+            return;
+        void* clos = reinterpret_cast<void*>(fcn);
+        destroy(CClosureGetEnv(clos));
+        CClosureFree(clos);
+        fcn = nullptr;
+        destroy = nullptr;
+    }
+
+    /**
+     * @brief Exchange the closures owned by two handles.
+     *
+     * @since 1.3.0
+     */
+    void swap(closure& other) noexcept {
+        std::swap(fcn, other.fcn);
+        std::swap(destroy, other.destroy);
+    }
+
+   private:
+    template <class F>
+    static R Invoke(CClosureCtx ctx, Args... args) {
+        if constexpr (std::is_void_v<R>)
+            std::invoke(*static_cast<F*>(ctx.env), std::forward<Args>(args)...);
+        else
+            return std::invoke(*static_cast<F*>(ctx.env),
+                               std::forward<Args>(args)...);
+    }
+
+    template <class F, class G>
+    void Bind(G&& callable) {
+        void* invoke = reinterpret_cast<void*>(&Invoke<F>);
+        if constexpr (detail::fitsInline<F>) {
+            void* clos = CClosureNewInline(invoke, nullptr, 0,
+                                           detail::returnsAggregate<R>);
+#ifdef __cpp_exceptions
+            try {
+                ::new (CClosureGetEnv(clos)) F(std::forward<G>(callable));
+            } catch (...) {
+                CClosureFree(clos);
+                throw;
+            }
+#else
+            ::new (CClosureGetEnv(clos)) F(std::forward<G>(callable));
+#endif
+            fcn = reinterpret_cast<pointer>(clos);
+            destroy = &detail::DestroyInline<F>;
+        } else {
+            F* env = new F(std::forward<G>(callable));
+            fcn = reinterpret_cast<pointer>(
+                CClosureNew(invoke, env, detail::returnsAggregate<R>));
+            destroy = &detail::DestroyHeap<F>;
+        }
+    }
+
+    pointer fcn = nullptr;
+    void (*destroy)(void*) noexcept = nullptr;
+};
+
+/**
+ * @brief Exchange the closures owned by two handles.
+ *
+ * @since 1.3.0
+ */
+template <class R, class... Args>
+void swap(closure<R(Args...)>& lhs, closure<R(Args...)>& rhs) noexcept {
+    lhs.swap(rhs);
+}
+
+}  // namespace cclosure
+
+#endif /* CCLOSURE_HPP */
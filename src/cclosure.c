@@ -19,10 +19,28 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 
+#ifdef STATIC_TRAMPOLINES
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#endif
+
 #ifdef THREAD_PTHREADS
 #include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef TRACE_USDT
+#include <sys/sdt.h>
+#endif
+
+#ifdef NUMA_BLOCKS
+#include <fcntl.h>
+#include <linux/mempolicy.h>
+#include <sys/syscall.h>
 #endif
 
 #undef _GNU_SOURCE
@@ -32,84 +50,506 @@
 
 /* ----- PRIVATE MACROS ----- */
 
+#if defined(STATIC_TRAMPOLINES)
+/* Trampolines come in tables that are mapped straight from the library's own
+ * text. Each one jumps through the stub pointer stored in its paired data
+ * entry, exactly one table size past the trampoline. */
+#define TrampData(clos) ((TrampData*)((uint8_t*)(clos) + TRAMP_TABLE_SIZE))
+#define IsInit(clos)                  \
+    (TrampData(clos)->stub != NULL && \
+     TrampData(clos)->stub != (void*)CClosureTrampUninit)
+
+#define TRAMP_TABLE_SIZE 16384
+#define TRAMPS_PER_TABLE (TRAMP_TABLE_SIZE / TRAMP_SIZE)
+#define TRAMP_MAX_SHIFT 7
+
 #ifdef __LP64__
 #define IsAggRet(clos) (false)
 
-#define THUNK_ENTRY_SIZE 26
+#define TRAMP_SIZE 32
+#else
+#define IsAggRet(clos) (TrampData(clos)->stub == (void*)CClosureTrampAgg)
+
+#define TRAMP_SIZE 16
+#endif
+#elif defined(__LP64__)
+#define IsAggRet(clos) (false)
+#define IsArgs(clos) (clos->args.bin[0] == 0x66)
+#define IsInit(clos) (clos->entry.bin[0] == 0x48 || IsArgs(clos))
+
+#define THUNK_ENTRY_SIZE 32
+#define THUNK_JUMP_SIZE 5
 #define THUNK_EXIT_SIZE 8
+#define THUNK_PAGE_STUB THUNK_EXIT_SIZE
+#define THUNK_ARGS_HEAD_SIZE 32
+#define THUNK_ARGS_SHIFT_SIZE 3
+#define THUNK_ARGS_TAIL_SIZE 6
+#define THUNK_ARGS_SIZE                                              \
+    (THUNK_ARGS_HEAD_SIZE +                                          \
+     THUNK_ARGS_SHIFT_SIZE * CCLOSURE_MAX_INT_ARGS + THUNK_ARGS_TAIL_SIZE)
+#define THUNK_BIND_SIZE 55
+#define THUNK_LINE 64
 #else
 #define IsAggRet(clos) (clos->entry.bin[0] == 0x5a)
+#define IsInit(clos) (clos->entry.bin[0] == 0x8d || IsAggRet(clos))
 
-#define THUNK_ENTRY_SIZE 14
+#define THUNK_ENTRY_SIZE 16
 #define THUNK_EXIT_SIZE 6
+#define THUNK_PAGE_STUB 0
+#define THUNK_LINE 32
+#endif
+
+/* Aligned thunks each start their own cache line (x86_64) or fetch block (x86)
+ * so that no thunk straddles one, at the cost of padding between thunks.
+ * Either way, thunks keep pointer alignment so that their immediates can be
+ * rewritten atomically. */
+#ifdef ALIGNED_THUNKS
+#define THUNK_ALIGN THUNK_LINE
+#else
+#define THUNK_ALIGN sizeof(void*)
+#endif
+
+/* Thunks are laid out page by page and never straddle one. On x86_64, the
+ * tail of every page holds the exit stub that its thunks call through. */
+#define THUNK_PAGE_SIZE 4096
+#define THUNKS_PER_PAGE ((THUNK_PAGE_SIZE - THUNK_PAGE_STUB) / sizeof(Closure))
+
+#define Str(val) StrRaw(val)
+#define StrRaw(val) #val
+
+#define TrampSym(name) \
+    extern __attribute__((visibility("hidden"))) const uint8_t name[]
+
+/* Number of slots moved between a thread's magazine and the bank at once. */
+#define MAG_BATCH 32
+#define MAG_CAP (MAG_BATCH * 2)
+#define LIMBO_CAP MAG_CAP
+
+/* Number of slots the batch functions move through the bank at once. */
+#define BATCH_CHUNK 256
+
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+/* Only defined by headers from Linux 5.14 on. */
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
+#define INLINE_ENV_SIZE CCLOSURE_MAX_INLINE_ENV
+
+/* Bound values past the first, which takes the place of the environment. */
+#define BIND_EXTRA_VALS (CCLOSURE_MAX_BIND_ARGS - 1)
+
+#ifdef THREAD_PTHREADS
+#define MAG_LOCAL __thread
+#else
+#define MAG_LOCAL
+#endif
+
+/* Counters are only ever written by their own thread, but may be read by any
+ * thread. A thread's counters are only summed once it is registered, which
+ * counting anything ensures. */
+#ifdef THREAD_PTHREADS
+static inline void MemMagRegister(void);
+
+#define MemStatAdd(field, num)                                           \
+    do {                                                                 \
+        MemMagRegister();                                                \
+        __atomic_store_n(&mag.stats.field, mag.stats.field + (num),      \
+                         __ATOMIC_RELAXED);                              \
+    } while (0)
+#else
+#define MemStatAdd(field, num) \
+    __atomic_store_n(&mag.stats.field, mag.stats.field + (num), __ATOMIC_RELAXED)
+#endif
+
+/* Static tracepoints in the "cclosure" provider, for use by perf or bpftrace.
+ * Arguments must not have side effects, as they vanish without tracing. */
+#ifdef TRACE_USDT
+#define Trace(...) STAP_PROBEV(cclosure, __VA_ARGS__)
+#else
+#define Trace(...) \
+    do {           \
+    } while (0)
+#endif
+
+/* Free list heads pack a generation tag above a 1-based slot index so that a
+ * stale head never compares equal after its slot was popped and pushed back. */
+#define FreeHead(tag, idx) (((uint64_t)(tag) << 32) | (uint32_t)(idx))
+#define FreeHeadTag(head) ((uint32_t)((head) >> 32))
+#define FreeHeadIdx(head) ((uint32_t)(head))
+
+/* Bank-level hints of which blocks currently hold free slots. */
+#define AVAIL_WORD_BITS 64
+#define AvailWords(cap) (((cap) + AVAIL_WORD_BITS - 1) / AVAIL_WORD_BITS)
+
+/* Block descriptors live in fixed chunks that never move once allocated, one
+ * chunk per avail word. */
+#define MEM_CHUNK_BLOCKS AVAIL_WORD_BITS
+#define MEM_DIR_CHUNKS 4096
+
+/* The block index is a radix tree over the page numbers of user addresses.
+ * Leaves cover 16 MiB and are only allocated where blocks live. */
+#define INDEX_PAGE_SHIFT 12
+#define INDEX_LEAF_BITS 12
+#ifdef __LP64__
+#define INDEX_MID_BITS 12
+#define INDEX_TOP_BITS 12
+#else
+#define INDEX_MID_BITS 4
+#define INDEX_TOP_BITS 4
+#endif
+#define INDEX_NONE SIZE_MAX
+#define INDEX_PAGE_BITS (INDEX_TOP_BITS + INDEX_MID_BITS + INDEX_LEAF_BITS)
+#define IndexTop(page) ((page) >> (INDEX_MID_BITS + INDEX_LEAF_BITS))
+#define IndexMid(page) \
+    (((page) >> INDEX_LEAF_BITS) & (((uintptr_t)1 << INDEX_MID_BITS) - 1))
+#define IndexLeaf(page) ((page) & (((uintptr_t)1 << INDEX_LEAF_BITS) - 1))
+
+#ifdef NUMA_BLOCKS
+/* Node masks passed to mbind fit in a single word. */
+#define MEM_MAX_NODES 32
+#else
+#define MEM_MAX_NODES 1
 #endif
 
 /* ----- PRIVATE TYPES ----- */
 
-typedef struct __attribute__((packed)) Closure {
+#ifdef STATIC_TRAMPOLINES
+/* Closures are trampolines in read-only code; this is never dereferenced. */
+typedef struct Closure Closure;
+
+typedef struct TrampData {
+    void* env;
+    void* fcn;
+    const void* stub;
+    const uintptr_t* bound;
+} TrampData;
+
+_Static_assert(sizeof(TrampData) <= TRAMP_SIZE,
+               "Trampoline data must fit in its entry.");
+#else
+typedef struct __attribute__((packed, aligned(THUNK_ALIGN))) Closure {
 #ifdef __LP64__
     union {
-        uint8_t bin[THUNK_ENTRY_SIZE];
+        struct __attribute__((packed)) {
+            union {
+                uint8_t bin[THUNK_ENTRY_SIZE];
+                union {
+                    struct __attribute__((packed)) {
+                        uint8_t pad0[8];
+                        void* env;
+                        uint8_t pad1[8];
+                        void* fcn;
+                    } norm, agg;
+                } tmpl;
+            } entry;
+            uint8_t jump[THUNK_JUMP_SIZE];
+        };
         union {
+            uint8_t bin[THUNK_ARGS_SIZE];
+            uint8_t bind[THUNK_BIND_SIZE];
             struct __attribute__((packed)) {
-                uint8_t pad0[6];
+                uint8_t pad0[8];
                 void* env;
-                uint8_t pad1[4];
+                uint8_t pad1[8];
                 void* fcn;
-            } norm, agg;
-        } tmpl;
-    } entry;
-    const uint8_t exit[THUNK_EXIT_SIZE];
+            } tmpl;
+        } args;
+    };
 #else
     union {
         uint8_t bin[THUNK_ENTRY_SIZE];
         union {
-            struct __attribute__((packed)) {
-                uint8_t pad0[1];
-                void* env;
-                uint8_t pad1[1];
-                void* fcn;
-                uint8_t pad2[4];
-            } norm;
             struct __attribute__((packed)) {
                 uint8_t pad0[4];
                 void* env;
-                uint8_t pad1[2];
+                uint8_t pad1[4];
                 void* fcn;
-            } agg;
+            } norm, agg;
         } tmpl;
     } entry;
     const uint8_t exit[THUNK_EXIT_SIZE];
 #endif
 } Closure;
 
+#ifdef __LP64__
+_Static_assert(offsetof(Closure, entry.tmpl.norm.env) % sizeof(void*) == 0 &&
+                   offsetof(Closure, entry.tmpl.norm.fcn) % sizeof(void*) == 0 &&
+                   offsetof(Closure, args.tmpl.env) % sizeof(void*) == 0 &&
+                   offsetof(Closure, args.tmpl.fcn) % sizeof(void*) == 0,
+               "Thunk immediates must be naturally aligned.");
+_Static_assert(THUNK_ARGS_HEAD_SIZE == THUNK_ENTRY_SIZE &&
+                   offsetof(Closure, args.tmpl.env) ==
+                       offsetof(Closure, entry.tmpl.norm.env) &&
+                   offsetof(Closure, args.tmpl.fcn) ==
+                       offsetof(Closure, entry.tmpl.norm.fcn),
+               "Argument-shifting thunks must share the entry layout.");
+_Static_assert(THUNK_BIND_SIZE <= sizeof(Closure) &&
+                   THUNK_BIND_SIZE <= (THUNK_ARGS_SIZE + sizeof(void*) - 1) /
+                                          sizeof(void*) * sizeof(void*),
+               "Bound values must not make closures any larger.");
+#else
+_Static_assert(offsetof(Closure, entry.tmpl.norm.env) % sizeof(void*) == 0 &&
+                   offsetof(Closure, entry.tmpl.norm.fcn) % sizeof(void*) == 0,
+               "Thunk immediates must be naturally aligned.");
+#endif
+#endif
+
 typedef struct MemSlot {
-    Closure clos;
-    struct MemSlot* nextFree;
-    const size_t blockIdx;
+    uint32_t nextFree;
 } MemSlot;
 
 typedef struct MemBlock {
     const size_t rawSize;
-    MemSlot* firstFree;
+    const size_t span;
+    const size_t cap;
+    uint64_t firstFree;
+    size_t freeCount;
+    size_t highWater;
+    size_t node;
+    bool committed;
+    size_t nextDecommitted;
+    Closure* const thunks;
     MemSlot* const slots;
-#ifdef THREAD_PTHREADS
-    pthread_rwlock_t lock;
-#endif
+    uint8_t* const envs;
 } MemBlock;
 
+/* Entries hold block indices plus one, so that zero means no block. */
+typedef struct MemIndexLeaf {
+    uint32_t entries[(size_t)1 << INDEX_LEAF_BITS];
+} MemIndexLeaf;
+
+typedef struct MemIndexMid {
+    MemIndexLeaf* leaves[(size_t)1 << INDEX_MID_BITS];
+} MemIndexMid;
+
+typedef struct MemChunk {
+    uint64_t avail;
+    MemBlock blocks[MEM_CHUNK_BLOCKS];
+} MemChunk;
+
 typedef struct MemBank {
-    size_t cap;
     size_t size;
-    MemBlock* blocks;
+    size_t grows;
+    size_t reserved;
+#ifdef NUMA_BLOCKS
+    size_t numNodes;
+#endif
+    MemIndexMid* index[(size_t)1 << INDEX_TOP_BITS];
+    /* Decommitted blocks of each node, linked through their descriptors by
+     * index plus one, so that zero ends a list. */
+    size_t decommitted[MEM_MAX_NODES];
 #ifdef THREAD_PTHREADS
     pthread_rwlock_t lock;
 #endif
+    MemChunk* dir[MEM_DIR_CHUNKS];
 } MemBank;
 
+typedef struct MemStats {
+    uint64_t created;
+    uint64_t freed;
+    uint64_t lockContended;
+    uint64_t lockWaitNs;
+} MemStats;
+
+typedef struct MemReader {
+    uint64_t epoch;
+    bool inUse;
+    struct MemReader* next;
+} MemReader;
+
+typedef struct MemRetired {
+    Closure* slot;
+    uint64_t epoch;
+} MemRetired;
+
+typedef struct MemMag {
+    size_t size;
+#ifdef THREAD_PTHREADS
+    bool registered;
+    struct MemMag* next;
+    MemReader* reader;
+    size_t limboSize;
+    MemRetired limbo[LIMBO_CAP];
+#endif
+    MemStats stats;
+    Closure* slots[MAG_CAP];
+} MemMag;
+
+struct CClosureArena {
+    Closure* thunks;
+    size_t next;
+    size_t cap;
+    size_t count;
+    size_t numBlocks;
+    size_t blocksCap;
+    size_t* blocks;
+};
+
+struct CClosurePool {
+    CClosureArena arena;
+    size_t numFree;
+    size_t freeCap;
+    Closure** free;
+};
+
 /* ----- PRIVATE CONSTANTS ----- */
 
+#if defined(STATIC_TRAMPOLINES)
 #ifdef __LP64__
+/* Every trampoline loads the address of its data entry into r10, which the
+ * stubs use to find the environment and callback. */
+__asm__(
+    ".pushsection .text.cclosure_tramp, \"ax\", @progbits\n"
+    ".balign 4096\n"
+    ".globl CClosureTrampTable\n"
+    ".hidden CClosureTrampTable\n"
+    "CClosureTrampTable:\n"
+    ".rept " Str(TRAMPS_PER_TABLE) "\n"
+    "    leaq (" Str(TRAMP_TABLE_SIZE) " - 7)(%rip), %r10\n"
+    "    jmpq *16(%r10)\n"
+    "    .balign " Str(TRAMP_SIZE) ", 0xcc\n"
+    ".endr\n"
+    ".balign 16\n"
+    ".globl CClosureTrampNorm\n"
+    ".hidden CClosureTrampNorm\n"
+    "CClosureTrampNorm:\n"
+    "    subq $16, %rsp\n"
+    "    pushq (%r10)\n"
+    "    callq *8(%r10)\n"
+    "    addq $24, %rsp\n"
+    "    ret\n"
+    ".balign 16\n"
+    ".globl CClosureTrampArgs5\n"
+    ".hidden CClosureTrampArgs5\n"
+    ".globl CClosureTrampArgs4\n"
+    ".hidden CClosureTrampArgs4\n"
+    ".globl CClosureTrampArgs3\n"
+    ".hidden CClosureTrampArgs3\n"
+    ".globl CClosureTrampArgs2\n"
+    ".hidden CClosureTrampArgs2\n"
+    ".globl CClosureTrampArgs1\n"
+    ".hidden CClosureTrampArgs1\n"
+    ".globl CClosureTrampArgs0\n"
+    ".hidden CClosureTrampArgs0\n"
+    "CClosureTrampArgs5:\n"
+    "    movq %r8, %r9\n"
+    "CClosureTrampArgs4:\n"
+    "    movq %rcx, %r8\n"
+    "CClosureTrampArgs3:\n"
+    "    movq %rdx, %rcx\n"
+    "CClosureTrampArgs2:\n"
+    "    movq %rsi, %rdx\n"
+    "CClosureTrampArgs1:\n"
+    "    movq %rdi, %rsi\n"
+    "CClosureTrampArgs0:\n"
+    "    movq (%r10), %rdi\n"
+    "    jmpq *8(%r10)\n"
+    ".balign 16\n"
+    ".globl CClosureTrampBind2\n"
+    ".hidden CClosureTrampBind2\n"
+    "CClosureTrampBind2:\n"
+    "    movq %rcx, %r9\n"
+    "    movq %rdx, %r8\n"
+    "    movq %rsi, %rcx\n"
+    "    movq %rdi, %rdx\n"
+    "    movq 24(%r10), %r11\n"
+    "    movq (%r11), %rsi\n"
+    "    movq (%r10), %rdi\n"
+    "    jmpq *8(%r10)\n"
+    ".balign 16\n"
+    ".globl CClosureTrampBind3\n"
+    ".hidden CClosureTrampBind3\n"
+    "CClosureTrampBind3:\n"
+    "    movq %rdx, %r9\n"
+    "    movq %rsi, %r8\n"
+    "    movq %rdi, %rcx\n"
+    "    movq 24(%r10), %r11\n"
+    "    movq 8(%r11), %rdx\n"
+    "    movq (%r11), %rsi\n"
+    "    movq (%r10), %rdi\n"
+    "    jmpq *8(%r10)\n"
+    ".balign 16\n"
+    ".globl CClosureTrampUninit\n"
+    ".hidden CClosureTrampUninit\n"
+    "CClosureTrampUninit:\n"
+    "    ud2\n"
+    ".popsection\n");
+
+TrampSym(CClosureTrampTable);
+TrampSym(CClosureTrampNorm);
+TrampSym(CClosureTrampArgs0);
+TrampSym(CClosureTrampArgs1);
+TrampSym(CClosureTrampArgs2);
+TrampSym(CClosureTrampArgs3);
+TrampSym(CClosureTrampArgs4);
+TrampSym(CClosureTrampArgs5);
+TrampSym(CClosureTrampBind2);
+TrampSym(CClosureTrampBind3);
+TrampSym(CClosureTrampUninit);
+
+#define CClosureTrampAgg CClosureTrampNorm
+
+static const uint8_t* const TRAMP_ARGS[CCLOSURE_MAX_INT_ARGS + 1] = {
+    CClosureTrampArgs0, CClosureTrampArgs1, CClosureTrampArgs2,
+    CClosureTrampArgs3, CClosureTrampArgs4, CClosureTrampArgs5};
+
+/* Trampolines have no room for more than one value, so the others are read
+ * through TrampData::bound. */
+static const uint8_t* const TRAMP_BIND[BIND_EXTRA_VALS] = {
+    CClosureTrampBind2, CClosureTrampBind3};
+#else
+/* Every trampoline loads the address of its data entry into eax, which the
+ * stubs use to find the environment and callback. */
+__asm__(
+    ".pushsection .text.cclosure_tramp, \"ax\", @progbits\n"
+    ".balign 4096\n"
+    ".globl CClosureTrampTable\n"
+    ".hidden CClosureTrampTable\n"
+    "CClosureTrampTable:\n"
+    ".rept " Str(TRAMPS_PER_TABLE) "\n"
+    "    call 1f\n"
+    "1:  popl %eax\n"
+    "    addl $(" Str(TRAMP_TABLE_SIZE) " - 5), %eax\n"
+    "    jmp *8(%eax)\n"
+    "    .balign " Str(TRAMP_SIZE) ", 0xcc\n"
+    ".endr\n"
+    ".balign 16\n"
+    ".globl CClosureTrampNorm\n"
+    ".hidden CClosureTrampNorm\n"
+    "CClosureTrampNorm:\n"
+    "    pushl (%eax)\n"
+    "    movl 4(%eax), %ecx\n"
+    "    call *%ecx\n"
+    "    addl $4, %esp\n"
+    "    ret\n"
+    ".balign 16\n"
+    ".globl CClosureTrampAgg\n"
+    ".hidden CClosureTrampAgg\n"
+    "CClosureTrampAgg:\n"
+    "    popl %edx\n"
+    "    popl %ecx\n"
+    "    pushl %edx\n"
+    "    pushl (%eax)\n"
+    "    pushl %ecx\n"
+    "    movl 4(%eax), %ecx\n"
+    "    call *%ecx\n"
+    "    addl $4, %esp\n"
+    "    ret\n"
+    ".balign 16\n"
+    ".globl CClosureTrampUninit\n"
+    ".hidden CClosureTrampUninit\n"
+    "CClosureTrampUninit:\n"
+    "    ud2\n"
+    ".popsection\n");
+
+TrampSym(CClosureTrampTable);
+TrampSym(CClosureTrampNorm);
+TrampSym(CClosureTrampAgg);
+TrampSym(CClosureTrampUninit);
+#endif
+#elif defined(__LP64__)
 /* BITS 64
  *
  * %define tmpl_env strict QWORD 0
@@ -117,27 +557,37 @@ typedef struct MemBank {
  *
  * thunk_entry_norm_x86_64:
  * 		sub rsp, 8 * 2
+ * 		xchg ax, ax
  * 		mov r11, tmpl_env
  * 		push r11
+ * 		nop dword [rax]
  * 		mov r11, tmpl_fcn
  */
 static const uint8_t THUNK_ENTRY_NORM[THUNK_ENTRY_SIZE] = {
-    0x48, 0x83, 0xec, 0x10, 0x49, 0xbb, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x41, 0x53, 0x49, 0xbb,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    0x48, 0x83, 0xec, 0x10, 0x66, 0x90, 0x49, 0xbb, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x41, 0x53, 0x0f, 0x1f, 0x40, 0x00,
+    0x49, 0xbb, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
 static const uint8_t* THUNK_ENTRY_AGG = THUNK_ENTRY_NORM;
 
 /* BITS 64
  *
  * thunk_entry_uninit_x86_64:
- * 		times 24 nop
+ * 		times 30 nop
  * 		ud2
  */
 static const uint8_t THUNK_ENTRY_UNINIT[THUNK_ENTRY_SIZE] = {
-    0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90,
-    0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90,
-    0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x0f, 0x0b};
+    0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90,
+    0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90,
+    0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x0f, 0x0b};
+
+/* BITS 64
+ *
+ * thunk_jump_x86_64:
+ * 		jmp near thunk_exit_x86_64
+ */
+static const uint8_t THUNK_JUMP[THUNK_JUMP_SIZE] = {0xe9, 0x00, 0x00, 0x00,
+                                                    0x00};
 
 /* BITS 64
  *
@@ -145,9 +595,105 @@ static const uint8_t THUNK_ENTRY_UNINIT[THUNK_ENTRY_SIZE] = {
  * 		call r11
  * 		add rsp, 8 * 3
  * 		ret
+ *
+ * Shared by every thunk of a page and never rewritten, so that a callback
+ * always returns into it intact, even after freeing its own closure and
+ * having its slot reused by a thunk of another kind.
  */
 static const uint8_t THUNK_EXIT[THUNK_EXIT_SIZE] = {0x41, 0xff, 0xd3, 0x48,
                                                     0x83, 0xc4, 0x18, 0xc3};
+
+/* BITS 64
+ *
+ * %define tmpl_env strict QWORD 0
+ * %define tmpl_fcn strict QWORD 0
+ *
+ * thunk_args_head_x86_64:
+ * 		nop word [rax + rax]
+ * 		mov r10, tmpl_env
+ * 		nop word [rax + rax]
+ * 		mov r11, tmpl_fcn
+ */
+static const uint8_t THUNK_ARGS_HEAD[THUNK_ARGS_HEAD_SIZE] = {
+    0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00, 0x49, 0xba, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x66, 0x0f, 0x1f, 0x44, 0x00, 0x00,
+    0x49, 0xbb, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+/* BITS 64
+ *
+ * thunk_args_shift_x86_64:
+ * 		mov r9, r8
+ * 		mov r8, rcx
+ * 		mov rcx, rdx
+ * 		mov rdx, rsi
+ * 		mov rsi, rdi
+ */
+static const uint8_t
+    THUNK_ARGS_SHIFT[CCLOSURE_MAX_INT_ARGS * THUNK_ARGS_SHIFT_SIZE] = {
+        0x4d, 0x89, 0xc1, 0x49, 0x89, 0xc8, 0x48, 0x89,
+        0xd1, 0x48, 0x89, 0xf2, 0x48, 0x89, 0xfe};
+
+/* BITS 64
+ *
+ * thunk_args_tail_x86_64:
+ * 		mov rdi, r10
+ * 		jmp r11
+ */
+static const uint8_t THUNK_ARGS_TAIL[THUNK_ARGS_TAIL_SIZE] = {
+    0x4c, 0x89, 0xd7, 0x41, 0xff, 0xe3};
+
+/* BITS 64
+ *
+ * %define tmpl_env strict QWORD 0
+ * %define tmpl_fcn strict QWORD 0
+ * %define tmpl_val strict QWORD 0
+ *
+ * thunk_bind2_x86_64:
+ * 		xchg ax, ax
+ * 		mov r9, rcx
+ * 		nop
+ * 		mov r10, tmpl_env
+ * 		mov r8, rdx
+ * 		mov rcx, rsi
+ * 		mov r11, tmpl_fcn
+ * 		mov rdx, rdi
+ * 		mov rsi, tmpl_val
+ * 		mov rdi, r10
+ * 		jmp r11
+ * 		times 4 int3
+ *
+ * thunk_bind3_x86_64:
+ * 		xchg ax, ax
+ * 		mov rcx, rdi
+ * 		nop
+ * 		mov rdi, tmpl_env
+ * 		mov r9, rdx
+ * 		mov r8, rsi
+ * 		mov r11, tmpl_fcn
+ * 		mov rsi, tmpl_val
+ * 		mov rdx, tmpl_val
+ * 		jmp r11
+ *
+ * Both keep the immediates of THUNK_ARGS_HEAD in place, but move registers in
+ * its padding so that three values fit in a packed thunk. Three values leave
+ * the first register free before the environment is loaded, so it goes there
+ * directly.
+ */
+static const uint8_t THUNK_BIND[BIND_EXTRA_VALS][THUNK_BIND_SIZE] = {
+    {0x66, 0x90, 0x49, 0x89, 0xc9, 0x90, 0x49, 0xba, 0x00, 0x00, 0x00,
+     0x00, 0x00, 0x00, 0x00, 0x00, 0x49, 0x89, 0xd0, 0x48, 0x89, 0xf1,
+     0x49, 0xbb, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48,
+     0x89, 0xfa, 0x48, 0xbe, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+     0x00, 0x4c, 0x89, 0xd7, 0x41, 0xff, 0xe3, 0xcc, 0xcc, 0xcc, 0xcc},
+    {0x66, 0x90, 0x48, 0x89, 0xf9, 0x90, 0x48, 0xbf, 0x00, 0x00, 0x00,
+     0x00, 0x00, 0x00, 0x00, 0x00, 0x49, 0x89, 0xd1, 0x49, 0x89, 0xf0,
+     0x49, 0xbb, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48,
+     0xbe, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0xba,
+     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x41, 0xff, 0xe3}};
+
+/* Offsets of the immediates holding every value past the first. */
+static const uint8_t THUNK_BIND_VALS[BIND_EXTRA_VALS][BIND_EXTRA_VALS] = {
+    {37, 0}, {34, 44}};
 #else
 /* BITS 32
  *
@@ -155,15 +701,14 @@ static const uint8_t THUNK_EXIT[THUNK_EXIT_SIZE] = {0x41, 0xff, 0xd3, 0x48,
  * %define tmpl_fcn strict DWORD 0
  *
  * thunk_entry_norm_x86:
- *      push tmpl_env
+ * 		lea esi, [esi + 0]
+ * 		push tmpl_env
+ * 		lea esi, [esi + 0]
  * 		mov ecx, tmpl_fcn
- * 		jmp thunk_entry_uninit_x86
- * 		ud2;
- * thunk_entry_uninit_x86:
  */
 static const uint8_t THUNK_ENTRY_NORM[THUNK_ENTRY_SIZE] = {
-    0x68, 0x00, 0x00, 0x00, 0x00, 0xb9, 0x00,
-    0x00, 0x00, 0x00, 0xeb, 0x02, 0x0f, 0x0b};
+    0x8d, 0x76, 0x00, 0x68, 0x00, 0x00, 0x00, 0x00,
+    0x8d, 0x76, 0x00, 0xb9, 0x00, 0x00, 0x00, 0x00};
 
 /* BITS 32
  *
@@ -176,21 +721,22 @@ static const uint8_t THUNK_ENTRY_NORM[THUNK_ENTRY_SIZE] = {
  * 		push edx
  * 		push tmpl_env
  * 		push ecx
+ * 		xchg ax, ax
  * 		mov ecx, tmpl_fcn
  */
 static const uint8_t THUNK_ENTRY_AGG[THUNK_ENTRY_SIZE] = {
-    0x5a, 0x59, 0x52, 0x68, 0x00, 0x00, 0x00,
-    0x00, 0x51, 0xb9, 0x00, 0x00, 0x00, 0x00};
+    0x5a, 0x59, 0x52, 0x68, 0x00, 0x00, 0x00, 0x00,
+    0x51, 0x66, 0x90, 0xb9, 0x00, 0x00, 0x00, 0x00};
 
 /* BITS 32
  *
  * thunk_entry_uninit_x86:
- * 		times 12 nop
+ * 		times 14 nop
  * 		ud2
  */
 static const uint8_t THUNK_ENTRY_UNINIT[THUNK_ENTRY_SIZE] = {
-    0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90,
-    0x90, 0x90, 0x90, 0x90, 0x90, 0x0f, 0x0b};
+    0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x90,
+    0x90, 0x90, 0x90, 0x90, 0x90, 0x90, 0x0f, 0x0b};
 
 /* BITS 32
  *
@@ -216,214 +762,1719 @@ CCLOSURE_EXPORT const CClosureThreadType CCLOSURE_THREAD_TYPE =
 
 static MemBank bank = {0};
 
-/* ----- PRIVATE FUNCTIONS ----- */
+static MAG_LOCAL MemMag mag = {0};
 
+/* The bank is set up when first needed rather than at load time. */
 #ifdef THREAD_PTHREADS
-static void UnlockRwLock(void* lock) {
-    pthread_rwlock_unlock((pthread_rwlock_t*)lock);
-
-    return;
-}
+static pthread_once_t bankOnce = PTHREAD_ONCE_INIT;
+#else
+static bool bankReady = false;
 #endif
 
-static void MemBlockInit(MemBlock* block, size_t blockIdx) {
 #ifdef THREAD_PTHREADS
-    pthread_rwlock_init(&block->lock, NULL);
+static pthread_key_t magKey;
+
+/* Registered magazines, whose counters are summed by CClosureGetStats, and the
+ * counters of magazines whose threads have since exited. */
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+static MemMag* magList = NULL;
+static MemStats retiredStats = {0};
+
+/* Freed slots are only reused once every reader that may still be looking at
+ * them has moved past the epoch they were freed in. Reader records are never
+ * freed, only recycled, so that they can be scanned without a lock. */
+static uint64_t globalEpoch = 1;
+static MemReader* readers = NULL;
 #endif
-    *(size_t*)&block->rawSize = getpagesize()
-                                << ((blockIdx > 11) ? 11 : blockIdx);
-    size_t cap = block->rawSize / sizeof(MemSlot);
-    *(MemSlot**)&block->slots =
-        mmap(NULL, block->rawSize, PROT_READ | PROT_WRITE | PROT_EXEC,
-             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    block->firstFree = block->slots + 0;
 
-    for (size_t idx = 0; idx < cap - 1; idx++) {
-        MemSlot* slot = block->slots + idx;
-        memcpy(slot->clos.entry.bin, THUNK_ENTRY_UNINIT, THUNK_ENTRY_SIZE);
-        memcpy((void*)slot->clos.exit, THUNK_EXIT, THUNK_EXIT_SIZE);
-        slot->nextFree = slot + 1;
-        *(size_t*)&slot->blockIdx = blockIdx;
+#ifdef STATIC_TRAMPOLINES
+static int32_t trampFd = -1;
+static off_t trampOffset = 0;
+#endif
+
+/* ----- PRIVATE FUNCTIONS ----- */
+
+#ifdef STATIC_TRAMPOLINES
+static void TrampLocate(void) {
+    /* Find the file and offset backing the trampoline table so that further
+     * copies of it can be mapped without ever writing to executable memory. */
+    FILE* maps = fopen("/proc/self/maps", "r");
+    if (maps == NULL)
+        return;
+
+    char line[4096 + 128];
+    char path[4096];
+    uintptr_t table = (uintptr_t)CClosureTrampTable;
+    while (fgets(line, sizeof(line), maps) != NULL) {
+        uintptr_t start, end;
+        unsigned long long offset;
+        path[0] = '\0';
+        if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " %*s %llx %*s %*s %4095[^\n]",
+                   &start, &end, &offset, path) < 3)
+            continue;
+        if (table < start || table >= end)
+            continue;
+        if (path[0] == '/') {
+            /* The mapping itself still refers to the file that was loaded,
+             * even if the path has since been replaced. */
+            char link[64];
+            snprintf(link, sizeof(link),
+                     "/proc/self/map_files/%" PRIxPTR "-%" PRIxPTR, start, end);
+            trampFd = open(link, O_RDONLY | O_CLOEXEC);
+            if (trampFd < 0)
+                trampFd = open(path, O_RDONLY | O_CLOEXEC);
+            trampOffset = (off_t)(offset + (table - start));
+        }
+        break;
     }
-    MemSlot* last = block->slots + cap - 1;
-    memcpy(last->clos.entry.bin, THUNK_ENTRY_UNINIT, THUNK_ENTRY_SIZE);
-    memcpy((void*)last->clos.exit, THUNK_EXIT, THUNK_EXIT_SIZE);
-    last->nextFree = NULL;
-    *(size_t*)&last->blockIdx = blockIdx;
+    fclose(maps);
 
     return;
 }
 
-static void MemBlockDeinit(MemBlock* block) {
-    munmap(block->slots, block->rawSize);
-#ifdef THREAD_PTHREADS
-    pthread_rwlock_destroy(&block->lock);
+static void TrampMap(void* addr) {
+    int flags = MAP_PRIVATE | MAP_FIXED;
+#ifdef HUGE_PAGES
+    /* Page cache backed code can't use huge pages, but it can at least skip
+     * faulting on first call. */
+    flags |= MAP_POPULATE;
 #endif
+    if (trampFd >= 0 &&
+        mmap(addr, TRAMP_TABLE_SIZE, PROT_READ | PROT_EXEC, flags, trampFd,
+             trampOffset) != MAP_FAILED) {
+        /* Only run what was read if it is the very table that was loaded, as
+         * the file may have been rewritten in place since. */
+        if (memcmp(addr, CClosureTrampTable, TRAMP_TABLE_SIZE) == 0)
+            return;
+        close(trampFd);
+        trampFd = -1;
+    }
+
+    /* Fall back to a private copy that is never writable and executable at
+     * the same time. */
+    if (mmap(addr, TRAMP_TABLE_SIZE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+        abort();
+    memcpy(addr, CClosureTrampTable, TRAMP_TABLE_SIZE);
+    if (mprotect(addr, TRAMP_TABLE_SIZE, PROT_READ | PROT_EXEC) != 0)
+        abort();
 
     return;
 }
+#endif
 
-__attribute__((constructor)) static void Constructor(void) {
-#ifdef THREAD_PTHREADS
-    pthread_rwlock_init(&bank.lock, NULL);
+static inline MemBlock* MemBankBlock(size_t blockIdx) {
+    return bank.dir[blockIdx / MEM_CHUNK_BLOCKS]->blocks +
+           blockIdx % MEM_CHUNK_BLOCKS;
+}
+
+static inline uint64_t* MemBankAvail(size_t wordIdx) {
+    return &bank.dir[wordIdx]->avail;
+}
+
+static inline Closure* MemThunkAt(Closure* thunks, size_t idx) {
+#ifdef STATIC_TRAMPOLINES
+    /* Each table of trampolines is followed by the table of their data. */
+    return (Closure*)((uint8_t*)thunks +
+                      idx / TRAMPS_PER_TABLE * TRAMP_TABLE_SIZE * 2 +
+                      idx % TRAMPS_PER_TABLE * TRAMP_SIZE);
+#else
+    return (Closure*)((uint8_t*)thunks +
+                      idx / THUNKS_PER_PAGE * THUNK_PAGE_SIZE) +
+           idx % THUNKS_PER_PAGE;
 #endif
-    bank.cap = 32;
-    bank.blocks = malloc(bank.cap * sizeof(MemBlock));
-    bank.size = 1;
-    MemBlockInit(bank.blocks + 0, 0);
+}
 
-    return;
+static inline Closure* MemBlockThunk(const MemBlock* block, size_t idx) {
+    return MemThunkAt(block->thunks, idx);
 }
 
-__attribute__((destructor)) static void Destructor(void) {
-    for (size_t idx = 0; idx < bank.size; idx++)
-        MemBlockDeinit(bank.blocks + idx);
-    free(bank.blocks);
-#ifdef THREAD_PTHREADS
-    pthread_rwlock_destroy(&bank.lock);
+static inline size_t MemThunkIdxAt(const Closure* thunks,
+                                   const Closure* clos) {
+#ifdef STATIC_TRAMPOLINES
+    size_t offset = (uint8_t*)clos - (uint8_t*)thunks;
+    return offset / (TRAMP_TABLE_SIZE * 2) * TRAMPS_PER_TABLE +
+           offset % (TRAMP_TABLE_SIZE * 2) / TRAMP_SIZE;
+#else
+    size_t offset = (uint8_t*)clos - (uint8_t*)thunks;
+    return offset / THUNK_PAGE_SIZE * THUNKS_PER_PAGE +
+           offset % THUNK_PAGE_SIZE / sizeof(Closure);
 #endif
-    bank = (MemBank){0};
+}
+
+static inline size_t MemBlockThunkIdx(const MemBlock* block,
+                                      const Closure* clos) {
+    return MemThunkIdxAt(block->thunks, clos);
+}
+
+static inline bool MemBlockOwns(const MemBlock* block, const void* addr) {
+    return (uint8_t*)addr >= (uint8_t*)block->thunks &&
+           (uint8_t*)addr < (uint8_t*)block->thunks + block->span;
+}
+
+#ifdef HUGE_PAGES
+static void MemBlockPrefault(void* addr, size_t size) {
+    /* Kernels without MADV_POPULATE_WRITE reject it, but the pages are still
+     * untouched then, so storing a zero into each one faults it in as well. */
+    if (madvise(addr, size, MADV_POPULATE_WRITE) != 0) {
+        size_t pageSize = getpagesize();
+        for (size_t offset = 0; offset < size; offset += pageSize)
+            ((volatile uint8_t*)addr)[offset] = 0;
+    }
 
     return;
 }
+#endif
 
-/* ----- PUBLIC FUNCTIONS ----- */
+static void* MemBlockMap(size_t size, int prot) {
+#ifdef HUGE_PAGES
+    /* Blocks large enough to hold a huge page are aligned to one so that the
+     * kernel may back them with huge pages; the slack is unmapped again. */
+    if (size >= HUGE_PAGE_SIZE) {
+        size_t slack = HUGE_PAGE_SIZE - getpagesize();
+        uint8_t* raw = mmap(NULL, size + slack, prot,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED)
+            abort();
+        uint8_t* aligned =
+            (uint8_t*)(((uintptr_t)raw + slack) & ~(HUGE_PAGE_SIZE - 1));
+        if (aligned > raw)
+            munmap(raw, aligned - raw);
+        if (aligned + size < raw + size + slack)
+            munmap(aligned + size, raw + slack - aligned);
+        /* Prefaulted only after the advice, so that the faults can already
+         * be served with huge pages. */
+        madvise(aligned, size, MADV_HUGEPAGE);
+        MemBlockPrefault(aligned, size);
 
-CCLOSURE_EXPORT void* CClosureNew(void* fcn, void* env, bool aggRet) {
-    /* Find block with free slot. */
-    MemBlock* block = NULL;
-#ifdef THREAD_PTHREADS
-    int32_t origCancelState;
-    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &origCancelState);
-    pthread_rwlock_rdlock(&bank.lock);
+        return aligned;
+    }
 #endif
-    for (size_t idx = 0; idx < bank.size; idx++) {
-        MemBlock* curBlock = bank.blocks + idx;
-#ifdef THREAD_PTHREADS
-        if (pthread_rwlock_trywrlock(&curBlock->lock) != 0)
-            continue;
+
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef HUGE_PAGES
+    flags |= MAP_POPULATE;
 #endif
-        if (curBlock->firstFree != NULL) {
-            block = curBlock;
-            break;
-        }
-#ifdef THREAD_PTHREADS
-        pthread_rwlock_unlock(&curBlock->lock);
+    void* addr = mmap(NULL, size, prot, flags, -1, 0);
+    if (addr == MAP_FAILED)
+        abort();
+
+    return addr;
+}
+
+#if !defined(STATIC_TRAMPOLINES) && defined(__LP64__)
+static uint8_t* ClosureExitStub(const Closure* clos) {
+    return (uint8_t*)(((uintptr_t)clos | (THUNK_PAGE_SIZE - 1)) + 1 -
+                      THUNK_EXIT_SIZE);
+}
 #endif
-    }
 
-    /* Create new block if none found. */
-    if (block == NULL) {
-#ifdef THREAD_PTHREADS
-        pthread_rwlock_unlock(&bank.lock);
-        pthread_rwlock_wrlock(&bank.lock);
+static void ClosureFormat(Closure* clos) {
+#ifdef STATIC_TRAMPOLINES
+    TrampData(clos)->stub = CClosureTrampUninit;
+#else
+    memcpy(clos->entry.bin, THUNK_ENTRY_UNINIT, THUNK_ENTRY_SIZE);
+#ifdef __LP64__
+    /* Slots of the same page may be formatted by several threads at once, but
+     * they all store the same stub, and only if it is not there yet. */
+    uint64_t stub;
+    memcpy(&stub, THUNK_EXIT, THUNK_EXIT_SIZE);
+    uint64_t* exit = (uint64_t*)ClosureExitStub(clos);
+    if (__atomic_load_n(exit, __ATOMIC_RELAXED) != stub)
+        __atomic_store_n(exit, stub, __ATOMIC_RELAXED);
+#else
+    memcpy((void*)clos->exit, THUNK_EXIT, THUNK_EXIT_SIZE);
 #endif
-        if (bank.size == bank.cap)
-            bank.blocks =
-                realloc(bank.blocks, (bank.cap *= 2) * sizeof(MemBlock));
-        MemBlockInit((block = bank.blocks + bank.size), bank.size);
-        bank.size++;
-#ifdef THREAD_PTHREADS
-        pthread_rwlock_wrlock(&block->lock);
 #endif
-    }
 
-    /* Consume free slot. */
-    MemSlot* slot = block->firstFree;
-    block->firstFree = slot->nextFree;
-    slot->nextFree = NULL;
-#ifdef THREAD_PTHREADS
-    pthread_rwlock_unlock(&block->lock);
-    pthread_rwlock_unlock(&bank.lock);
-    pthread_setcancelstate(origCancelState, &origCancelState);
-#endif
+    return;
+}
 
-    /* Initialize closure entry. */
-    Closure* clos = (Closure*)slot;
-    if (aggRet) {
-        memcpy(clos->entry.bin, THUNK_ENTRY_AGG, THUNK_ENTRY_SIZE);
-        clos->entry.tmpl.agg.fcn = fcn;
-        clos->entry.tmpl.agg.env = env;
-    } else {
-        memcpy(clos->entry.bin, THUNK_ENTRY_NORM, THUNK_ENTRY_SIZE);
-        clos->entry.tmpl.norm.fcn = fcn;
-        clos->entry.tmpl.norm.env = env;
+#ifdef NUMA_BLOCKS
+static size_t MemNodeCount(void) {
+    /* Possible nodes are listed as ranges, such as "0-1", so the highest
+     * number listed is the last node. */
+    char list[256];
+    int32_t fd = open("/sys/devices/system/node/possible", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 1;
+    ssize_t len = read(fd, list, sizeof(list) - 1);
+    close(fd);
+    if (len <= 0)
+        return 1;
+    list[len] = '\0';
+
+    size_t last = 0;
+    size_t num = 0;
+    for (const char* chr = list; *chr != '\0'; chr++) {
+        if (*chr >= '0' && *chr <= '9') {
+            num = num * 10 + (size_t)(*chr - '0');
+        } else {
+            last = (num > last) ? num : last;
+            num = 0;
+        }
     }
+    last = (num > last) ? num : last;
 
-    return clos;
+    return (last < MEM_MAX_NODES) ? last + 1 : MEM_MAX_NODES;
 }
-
-CCLOSURE_EXPORT void* CClosureFree(void* clos) {
-#define clos ((Closure*)clos)
-    /* Deinitialize closure entry. */
-    void* env =
-        (IsAggRet(clos)) ? clos->entry.tmpl.agg.env : clos->entry.tmpl.norm.env;
-#ifdef THREAD_PTHREADS
-    int32_t origCancelState;
-    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &origCancelState);
 #endif
-    memcpy(clos->entry.bin, THUNK_ENTRY_UNINIT, THUNK_ENTRY_SIZE);
 
-    /* Release free slot. */
-    MemSlot* slot = (MemSlot*)clos;
-#ifdef THREAD_PTHREADS
-    pthread_rwlock_rdlock(&bank.lock);
-#endif
-    MemBlock* block = bank.blocks + slot->blockIdx;
-#ifdef THREAD_PTHREADS
-    pthread_rwlock_wrlock(&block->lock);
-#endif
-    slot->nextFree = block->firstFree;
-    block->firstFree = slot;
-#ifdef THREAD_PTHREADS
-    pthread_rwlock_unlock(&block->lock);
-    pthread_rwlock_unlock(&bank.lock);
-    pthread_setcancelstate(origCancelState, &origCancelState);
+static inline size_t MemNodeCurrent(void) {
+#ifdef NUMA_BLOCKS
+    if (bank.numNodes > 1) {
+        uint32_t cpu;
+        uint32_t node;
+        if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0 &&
+            node < bank.numNodes)
+            return node;
+    }
 #endif
 
-    return env;
-#undef clos
+    return 0;
 }
 
-CCLOSURE_EXPORT bool CClosureCheck(void* clos) {
-    bool result = false;
-#ifdef THREAD_PTHREADS
-    pthread_rwlock_rdlock(&bank.lock);
-    pthread_cleanup_push(UnlockRwLock, &bank.lock);
+static void MemBlockPlace(MemBlock* block, size_t node) {
+#ifdef NUMA_BLOCKS
+    /* Only affects pages faulted in from now on, which is all of them for a
+     * new or decommitted block unless it was prefaulted. Failure just leaves
+     * placement to first touch, which happens on the caller's node anyway. */
+    if (bank.numNodes > 1) {
+        unsigned long mask = 1ul << node;
+        syscall(SYS_mbind, block->thunks, block->rawSize, MPOL_PREFERRED, &mask,
+                MEM_MAX_NODES + 1, 0);
+    }
 #endif
-    for (size_t idx = 0; idx < bank.size; idx++) {
-        MemBlock* block = bank.blocks + idx;
-        void* slots = block->slots;
-        if ((clos >= slots) && (clos < slots + block->rawSize)) {
-#ifdef THREAD_PTHREADS
-            pthread_rwlock_rdlock(&block->lock);
-            pthread_cleanup_push(UnlockRwLock, &block->lock);
+    block->node = node;
+
+    return;
+}
+
+static void MemBlockCommit(MemBlock* block) {
+#ifdef LOCKED_PAGES
+    /* Also faults the whole block in up front. Failure (usually from
+     * RLIMIT_MEMLOCK) just leaves the block pageable. */
+    mlock(block->thunks, block->rawSize);
 #endif
-            result = ((Closure*)clos)->entry.bin[0] != 0x90;
-#ifdef THREAD_PTHREADS
-            pthread_cleanup_pop(true);
+#ifdef HUGE_PAGES
+    /* Decommitting dropped the pages MemBlockMap prefaulted, so bring back
+     * the same ones it did. */
+    if (!block->committed) {
+#ifdef STATIC_TRAMPOLINES
+        for (size_t offset = TRAMP_TABLE_SIZE; offset < block->span;
+             offset += TRAMP_TABLE_SIZE * 2)
+            MemBlockPrefault((uint8_t*)block->thunks + offset,
+                             TRAMP_TABLE_SIZE);
+        MemBlockPrefault(block->slots, block->rawSize - block->span);
+#else
+        MemBlockPrefault(block->thunks, block->rawSize);
 #endif
-        }
-        if (result)
-            break;
     }
-#ifdef THREAD_PTHREADS
-    pthread_cleanup_pop(true);
 #endif
+    block->committed = true;
 
-    return result;
+    return;
 }
 
-CCLOSURE_EXPORT void* CClosureGetFcn(void* clos) {
-#define clos ((Closure*)clos)
-    return (IsAggRet(clos)) ? clos->entry.tmpl.agg.fcn
-                            : clos->entry.tmpl.norm.fcn;
-#undef clos
+static void MemBlockFormat(MemBlock* block) {
+    /* Slots are only formatted as they are first handed out, past the high
+     * water mark, so this costs the same for any block size. */
+    MemBlockCommit(block);
+    block->highWater = 0;
+    block->freeCount = block->cap;
+    block->firstFree = FreeHead(FreeHeadTag(block->firstFree) + 1, 0);
+
+    return;
 }
 
-CCLOSURE_EXPORT void* CClosureGetEnv(void* clos) {
+static void MemBlockInit(MemBlock* block, size_t scale, size_t node) {
+    /* Thunks and their allocator metadata live on separate pages so that
+     * free list traffic never writes to lines that are being executed. */
+    size_t pageSize = getpagesize();
+#ifdef STATIC_TRAMPOLINES
+    size_t tables = (size_t)1
+                    << ((scale > TRAMP_MAX_SHIFT) ? TRAMP_MAX_SHIFT : scale);
+    *(size_t*)&block->cap = tables * TRAMPS_PER_TABLE;
+    *(size_t*)&block->span = tables * TRAMP_TABLE_SIZE * 2;
+#else
+    *(size_t*)&block->span = pageSize << ((scale > 11) ? 11 : scale);
+    *(size_t*)&block->cap = block->span / THUNK_PAGE_SIZE * THUNKS_PER_PAGE;
+#endif
+    size_t metaSize = (block->cap * sizeof(MemSlot) + pageSize - 1) &
+                      ~(pageSize - 1);
+    /* Inline environments follow the metadata; their pages are only faulted
+     * in once a closure actually stores one. */
+    size_t envSize = (block->cap * INLINE_ENV_SIZE + pageSize - 1) &
+                     ~(pageSize - 1);
+    *(size_t*)&block->rawSize = block->span + metaSize + envSize;
+#ifdef STATIC_TRAMPOLINES
+    *(Closure**)&block->thunks =
+        MemBlockMap(block->rawSize, PROT_READ | PROT_WRITE);
+    for (size_t idx = 0; idx < tables; idx++)
+        TrampMap((uint8_t*)block->thunks + idx * TRAMP_TABLE_SIZE * 2);
+    *(MemSlot**)&block->slots =
+        (MemSlot*)((uint8_t*)block->thunks + block->span);
+    *(uint8_t**)&block->envs = (uint8_t*)block->slots + metaSize;
+#else
+    *(Closure**)&block->thunks =
+        MemBlockMap(block->rawSize, PROT_READ | PROT_WRITE | PROT_EXEC);
+    *(MemSlot**)&block->slots =
+        (MemSlot*)((uint8_t*)block->thunks + block->span);
+    *(uint8_t**)&block->envs = (uint8_t*)block->slots + metaSize;
+    mprotect(block->slots, metaSize + envSize, PROT_READ | PROT_WRITE);
+#endif
+    block->firstFree = FreeHead(0, 0);
+    /* Fresh from MemBlockMap, so there is nothing to fault back in. */
+    block->committed = true;
+    MemBlockPlace(block, node);
+    MemBlockFormat(block);
+
+    return;
+}
+
+static void MemBlockDecommit(MemBlock* block) {
+    /* The mapping is kept so that CClosureCheck may still read from it; its
+     * pages just read back as zeroes until the block is formatted again. */
+#ifdef LOCKED_PAGES
+    munlock(block->thunks, block->rawSize);
+#endif
+#ifdef STATIC_TRAMPOLINES
+    for (size_t offset = TRAMP_TABLE_SIZE; offset < block->span;
+         offset += TRAMP_TABLE_SIZE * 2)
+        madvise((uint8_t*)block->thunks + offset, TRAMP_TABLE_SIZE,
+                MADV_DONTNEED);
+    madvise(block->slots, block->rawSize - block->span, MADV_DONTNEED);
+#else
+    madvise(block->thunks, block->rawSize, MADV_DONTNEED);
+#endif
+    /* Releases still on their way may set the block's avail hint after this,
+     * so leave nothing for a pop to find, formatted or not, until the block
+     * is formatted again. */
+    block->freeCount = 0;
+    block->highWater = block->cap;
+    block->firstFree = FreeHead(FreeHeadTag(block->firstFree) + 1, 0);
+    block->committed = false;
+
+    return;
+}
+
+static void MemIndexInsert(const MemBlock* block, size_t blockIdx) {
+    /* Entries are only ever added, under the bank lock, and each is published
+     * after the node leading to it, so that lookups never need a lock. */
+    uintptr_t first = (uintptr_t)block->thunks >> INDEX_PAGE_SHIFT;
+    uintptr_t last = first + (block->span >> INDEX_PAGE_SHIFT);
+    if (last > (uintptr_t)1 << INDEX_PAGE_BITS)
+        abort();
+    for (uintptr_t page = first; page < last; page++) {
+        MemIndexMid** mid = bank.index + IndexTop(page);
+        if (*mid == NULL) {
+            MemIndexMid* newMid = calloc(1, sizeof(MemIndexMid));
+            if (newMid == NULL)
+                abort();
+            __atomic_store_n(mid, newMid, __ATOMIC_RELEASE);
+        }
+        MemIndexLeaf** leaf = (*mid)->leaves + IndexMid(page);
+        if (*leaf == NULL) {
+            MemIndexLeaf* newLeaf = calloc(1, sizeof(MemIndexLeaf));
+            if (newLeaf == NULL)
+                abort();
+            __atomic_store_n(leaf, newLeaf, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n((*leaf)->entries + IndexLeaf(page),
+                         (uint32_t)blockIdx + 1, __ATOMIC_RELEASE);
+    }
+
+    return;
+}
+
+static size_t MemIndexFind(const void* addr) {
+    uintptr_t page = (uintptr_t)addr >> INDEX_PAGE_SHIFT;
+    if (page >> INDEX_PAGE_BITS != 0)
+        return INDEX_NONE;
+    const MemIndexMid* mid =
+        __atomic_load_n(bank.index + IndexTop(page), __ATOMIC_ACQUIRE);
+    if (mid == NULL)
+        return INDEX_NONE;
+    const MemIndexLeaf* leaf =
+        __atomic_load_n(mid->leaves + IndexMid(page), __ATOMIC_ACQUIRE);
+    if (leaf == NULL)
+        return INDEX_NONE;
+    uint32_t entry =
+        __atomic_load_n(leaf->entries + IndexLeaf(page), __ATOMIC_ACQUIRE);
+
+    return (entry != 0) ? (size_t)entry - 1 : INDEX_NONE;
+}
+
+static uint8_t* MemInlineEnv(Closure* clos) {
+    const MemBlock* block = MemBankBlock(MemIndexFind(clos));
+
+    return block->envs + MemBlockThunkIdx(block, clos) * INLINE_ENV_SIZE;
+}
+
+static void MemBlockDeinit(MemBlock* block) {
+    Trace(block__deinit, block->thunks, block->rawSize);
+    munmap(block->thunks, block->rawSize);
+
+    return;
+}
+
+static size_t MemBlockPop(MemBlock* block, Closure** slots, size_t num) {
+    size_t count = 0;
+    uint64_t head = __atomic_load_n(&block->firstFree, __ATOMIC_ACQUIRE);
+    while (count < num && FreeHeadIdx(head) != 0) {
+        /* The head may be popped by another thread while we read its link, in
+         * which case the tag has moved on and the exchange below fails. */
+        uint32_t idx = FreeHeadIdx(head) - 1;
+        uint32_t next =
+            __atomic_load_n(&block->slots[idx].nextFree, __ATOMIC_RELAXED);
+        if (__atomic_compare_exchange_n(
+                &block->firstFree, &head, FreeHead(FreeHeadTag(head) + 1, next),
+                true, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            slots[count++] = MemBlockThunk(block, idx);
+            head = __atomic_load_n(&block->firstFree, __ATOMIC_ACQUIRE);
+        }
+    }
+
+    /* Then hand out slots that were never used since the block was formatted,
+     * formatting them on the way. */
+    size_t mark = __atomic_load_n(&block->highWater, __ATOMIC_RELAXED);
+    size_t take;
+    do {
+        take = (num - count < block->cap - mark) ? num - count
+                                                 : block->cap - mark;
+    } while (take > 0 && !__atomic_compare_exchange_n(
+                             &block->highWater, &mark, mark + take, true,
+                             __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    for (size_t idx = 0; idx < take; idx++) {
+        Closure* clos = MemBlockThunk(block, mark + idx);
+        ClosureFormat(clos);
+        slots[count++] = clos;
+    }
+    __atomic_sub_fetch(&block->freeCount, count, __ATOMIC_RELAXED);
+
+    return count;
+}
+
+static size_t MemBlockPush(MemBlock* block,
+                           size_t first,
+                           size_t last,
+                           size_t num) {
+    uint64_t head = __atomic_load_n(&block->firstFree, __ATOMIC_RELAXED);
+    uint64_t newHead;
+    do {
+        __atomic_store_n(&block->slots[last].nextFree, FreeHeadIdx(head),
+                         __ATOMIC_RELAXED);
+        newHead = FreeHead(FreeHeadTag(head) + 1, first + 1);
+    } while (!__atomic_compare_exchange_n(&block->firstFree, &head, newHead,
+                                          true, __ATOMIC_SEQ_CST,
+                                          __ATOMIC_RELAXED));
+
+    return __atomic_add_fetch(&block->freeCount, num, __ATOMIC_RELAXED);
+}
+
+#ifdef THREAD_PTHREADS
+static inline uint64_t MemNowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static void MemBankLock(int (*tryLock)(pthread_rwlock_t*),
+                        int (*lock)(pthread_rwlock_t*)) {
+    /* Only pay for timing when the lock is actually contended. */
+    if (tryLock(&bank.lock) == 0)
+        return;
+    uint64_t start = MemNowNs();
+    lock(&bank.lock);
+    uint64_t waitNs = MemNowNs() - start;
+    MemStatAdd(lockContended, 1);
+    MemStatAdd(lockWaitNs, waitNs);
+    Trace(lock__wait, waitNs, lock == pthread_rwlock_wrlock);
+
+    return;
+}
+#endif
+
+static void MemBankMarkAvail(size_t blockIdx) {
+    uint64_t* word = MemBankAvail(blockIdx / AVAIL_WORD_BITS);
+    uint64_t mask = (uint64_t)1 << (blockIdx % AVAIL_WORD_BITS);
+    if (!(__atomic_load_n(word, __ATOMIC_SEQ_CST) & mask))
+        __atomic_fetch_or(word, mask, __ATOMIC_SEQ_CST);
+
+    return;
+}
+
+static void MemBankMarkEmpty(size_t blockIdx) {
+    uint64_t* word = MemBankAvail(blockIdx / AVAIL_WORD_BITS);
+    uint64_t mask = (uint64_t)1 << (blockIdx % AVAIL_WORD_BITS);
+    __atomic_fetch_and(word, ~mask, __ATOMIC_SEQ_CST);
+
+    /* A slot may have been pushed between our last pop and clearing the hint,
+     * in which case its pusher could have seen the hint still set. */
+    uint64_t head =
+        __atomic_load_n(&MemBankBlock(blockIdx)->firstFree, __ATOMIC_SEQ_CST);
+    if (FreeHeadIdx(head) != 0)
+        MemBankMarkAvail(blockIdx);
+
+    return;
+}
+
+static size_t MemBankTake(size_t blockIdx, Closure** slots, size_t num) {
+    size_t count = MemBlockPop(MemBankBlock(blockIdx), slots, num);
+    if (count < num)
+        MemBankMarkEmpty(blockIdx);
+
+    return count;
+}
+
+static size_t MemBankTakeAvail(Closure** slots, size_t num, size_t node) {
+    /* Blocks on the caller's node go first, so that closures run from local
+     * memory. Other nodes' free slots still beat growing the bank, which would
+     * otherwise keep growing while threads on one node free what threads on
+     * another create. */
+    size_t count = 0;
+    for (size_t pass = 0; pass < 2 && count < num; pass++) {
+        for (size_t wordIdx = 0;
+             wordIdx < AvailWords(bank.size) && count < num; wordIdx++) {
+            uint64_t bits =
+                __atomic_load_n(MemBankAvail(wordIdx), __ATOMIC_RELAXED);
+            while (bits != 0 && count < num) {
+                size_t blockIdx =
+                    wordIdx * AVAIL_WORD_BITS + __builtin_ctzll(bits);
+                bits &= bits - 1;
+                if ((MemBankBlock(blockIdx)->node == node) == (pass == 0))
+                    count +=
+                        MemBankTake(blockIdx, slots + count, num - count);
+            }
+        }
+    }
+
+    return count;
+}
+
+static void MemBankDecommit(size_t blockIdx) {
+    MemBlock* block = MemBankBlock(blockIdx);
+    MemBlockDecommit(block);
+    block->nextDecommitted = bank.decommitted[block->node];
+    bank.decommitted[block->node] = blockIdx + 1;
+
+    return;
+}
+
+static size_t MemBankPopDecommitted(size_t node) {
+    /* A block last used on the same node has the right policy already. Only
+     * takes as long as there are nodes, however many blocks there are. */
+    size_t from = node;
+    if (bank.decommitted[from] == 0) {
+        from = 0;
+        while (from < MEM_MAX_NODES && bank.decommitted[from] == 0)
+            from++;
+        if (from == MEM_MAX_NODES)
+            return bank.size;
+    }
+    size_t blockIdx = bank.decommitted[from] - 1;
+    MemBlock* block = MemBankBlock(blockIdx);
+    bank.decommitted[from] = block->nextDecommitted;
+    if (from != node)
+        MemBlockPlace(block, node);
+
+    return blockIdx;
+}
+
+static size_t MemBankAddBlock(size_t scale, size_t node) {
+    /* Descriptors never move, so threads that found a block through the
+     * index may keep using it without the bank lock. */
+    if (bank.size % MEM_CHUNK_BLOCKS == 0) {
+        size_t chunkIdx = bank.size / MEM_CHUNK_BLOCKS;
+        if (chunkIdx == MEM_DIR_CHUNKS)
+            abort();
+        bank.dir[chunkIdx] = calloc(1, sizeof(MemChunk));
+        if (bank.dir[chunkIdx] == NULL)
+            abort();
+    }
+    MemBlock* block = MemBankBlock(bank.size);
+    MemBlockInit(block, scale, node);
+    MemIndexInsert(block, bank.size);
+    Trace(block__init, bank.size, block->thunks, block->rawSize, block->cap);
+
+    return bank.size++;
+}
+
+static size_t MemBankGrow(size_t node) {
+    /* Prefer bringing back a decommitted block over mapping a new one. */
+    size_t blockIdx = MemBankPopDecommitted(node);
+    if (blockIdx < bank.size)
+        MemBlockFormat(MemBankBlock(blockIdx));
+    else
+        blockIdx = MemBankAddBlock(bank.size, node);
+    MemBankMarkAvail(blockIdx);
+
+    return blockIdx;
+}
+
+static void MemBankTrim(void) {
+#ifdef THREAD_PTHREADS
+    int32_t origCancelState;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &origCancelState);
+    MemBankLock(pthread_rwlock_trywrlock, pthread_rwlock_wrlock);
+#endif
+    size_t live = 0;
+    for (size_t idx = 0; idx < bank.size; idx++) {
+        MemBlock* block = MemBankBlock(idx);
+        if (block->committed)
+            live += block->cap - block->freeCount;
+    }
+
+    /* Keep one empty block, and as many more as the live closures could
+     * refill or the reservation asks for, so that churn around a steady count
+     * does not thrash. */
+    size_t spare = 0;
+    for (size_t idx = 0; idx < bank.size; idx++) {
+        MemBlock* block = MemBankBlock(idx);
+        if (!block->committed || block->freeCount != block->cap)
+            continue;
+        if (spare == 0 || spare + block->cap <= live ||
+            spare < bank.reserved) {
+            spare += block->cap;
+            continue;
+        }
+        MemBankDecommit(idx);
+        MemBankMarkEmpty(idx);
+    }
+#ifdef THREAD_PTHREADS
+    pthread_rwlock_unlock(&bank.lock);
+    pthread_setcancelstate(origCancelState, &origCancelState);
+#endif
+
+    return;
+}
+
+static void MemBankSetup(void) {
+#ifdef STATIC_TRAMPOLINES
+    TrampLocate();
+#endif
+#ifdef NUMA_BLOCKS
+    bank.numNodes = MemNodeCount();
+#endif
+
+    return;
+}
+
+static inline void MemBankReady(void) {
+#ifdef THREAD_PTHREADS
+    pthread_once(&bankOnce, MemBankSetup);
+#else
+    if (!bankReady) {
+        bankReady = true;
+        MemBankSetup();
+    }
+#endif
+
+    return;
+}
+
+static void MemBankClaim(Closure** slots, size_t num) {
+    MemBankReady();
+    size_t count = 0;
+    size_t node = MemNodeCurrent();
+
+    /* Take free slots from existing blocks. */
+#ifdef THREAD_PTHREADS
+    MemBankLock(pthread_rwlock_tryrdlock, pthread_rwlock_rdlock);
+#endif
+    count += MemBankTakeAvail(slots + count, num - count, node);
+
+    /* Create new blocks until satisfied. */
+    if (count < num) {
+#ifdef THREAD_PTHREADS
+        int32_t origCancelState;
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &origCancelState);
+        pthread_rwlock_unlock(&bank.lock);
+        MemBankLock(pthread_rwlock_trywrlock, pthread_rwlock_wrlock);
+
+        /* Another thread may have grown the bank or freed slots meanwhile. */
+        count += MemBankTakeAvail(slots + count, num - count, node);
+#endif
+        while (count < num) {
+            bank.grows++;
+            size_t blockIdx = MemBankGrow(node);
+            Trace(bank__grow, blockIdx, bank.size);
+            count += MemBankTake(blockIdx, slots + count, num - count);
+        }
+#ifdef THREAD_PTHREADS
+        pthread_setcancelstate(origCancelState, &origCancelState);
+#endif
+    }
+#ifdef THREAD_PTHREADS
+    pthread_rwlock_unlock(&bank.lock);
+#endif
+
+    return;
+}
+
+static bool MemBankReserve(size_t num) {
+    /* More slots than physical memory could hold can never all be mapped, so
+     * refuse them up front rather than growing until mmap fails. */
+#ifdef STATIC_TRAMPOLINES
+    uint64_t slotSize = TRAMP_SIZE * 2;
+#else
+    uint64_t slotSize = sizeof(Closure);
+#endif
+    slotSize += sizeof(MemSlot) + INLINE_ENV_SIZE;
+    long physPages = sysconf(_SC_PHYS_PAGES);
+    if (physPages > 0 &&
+        num > (uint64_t)physPages * (uint64_t)getpagesize() / slotSize)
+        return false;
+
+    MemBankReady();
+#ifdef THREAD_PTHREADS
+    int32_t origCancelState;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &origCancelState);
+    MemBankLock(pthread_rwlock_trywrlock, pthread_rwlock_wrlock);
+#endif
+    bank.reserved = num;
+    size_t node = MemNodeCurrent();
+    size_t numFree = 0;
+    for (size_t idx = 0; idx < bank.size; idx++) {
+        MemBlock* block = MemBankBlock(idx);
+        if (block->committed && block->node == node)
+            numFree += block->freeCount;
+    }
+
+    /* Grow ahead of time so that claims never have to. Decommitted blocks are
+     * not counted above, but growing brings them back before mapping new
+     * ones. */
+    while (numFree < num) {
+        bank.grows++;
+        size_t blockIdx = MemBankGrow(node);
+        Trace(bank__grow, blockIdx, bank.size);
+        numFree += MemBankBlock(blockIdx)->cap;
+    }
+#ifdef THREAD_PTHREADS
+    pthread_rwlock_unlock(&bank.lock);
+    pthread_setcancelstate(origCancelState, &origCancelState);
+#endif
+
+    return true;
+}
+
+static void MemBankRelease(Closure* const* slots, size_t num) {
+    /* No bank lock is needed, as descriptors never move and a block can only
+     * be decommitted once all of its slots, including ours, have been pushed.
+     * A hint set on a block that was decommitted meanwhile finds both its
+     * free list empty and its high water mark at capacity, so it hands out
+     * nothing and is cleared again. */
+    bool emptied = false;
+    for (size_t idx = 0; idx < num;) {
+        /* Consecutive slots usually share a block, so link them into a chain
+         * and push it with a single exchange. */
+        size_t blockIdx = MemIndexFind(slots[idx]);
+        MemBlock* block = MemBankBlock(blockIdx);
+        size_t first = MemBlockThunkIdx(block, slots[idx]);
+        size_t last = first;
+        size_t len = 1;
+        for (idx++; idx < num && MemBlockOwns(block, slots[idx]);
+             idx++, len++) {
+            size_t next = MemBlockThunkIdx(block, slots[idx]);
+            __atomic_store_n(&block->slots[last].nextFree, next + 1,
+                             __ATOMIC_RELAXED);
+            last = next;
+        }
+        if (MemBlockPush(block, first, last, len) >= block->cap)
+            emptied = true;
+        MemBankMarkAvail(blockIdx);
+    }
+
+    /* Give fully freed blocks back to the kernel. */
+    if (emptied)
+        MemBankTrim();
+
+    return;
+}
+
+static void MemArenaGrow(CClosureArena* arena) {
+    /* Make room to remember the block before taking it. */
+    if (arena->numBlocks == arena->blocksCap) {
+        size_t blocksCap = (arena->blocksCap == 0) ? 4 : arena->blocksCap * 2;
+        size_t* blocks = realloc(arena->blocks, blocksCap * sizeof(size_t));
+        if (blocks == NULL)
+            abort();
+        arena->blocks = blocks;
+        arena->blocksCap = blocksCap;
+    }
+
+    MemBankReady();
+#ifdef THREAD_PTHREADS
+    int32_t origCancelState;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &origCancelState);
+    MemBankLock(pthread_rwlock_trywrlock, pthread_rwlock_wrlock);
+#endif
+    /* A decommitted block costs nothing to take over, as slots are only
+     * formatted as the arena reaches them. Otherwise map a block that grows
+     * along with the arena. */
+    size_t node = MemNodeCurrent();
+    size_t blockIdx = MemBankPopDecommitted(node);
+    if (blockIdx < bank.size)
+        MemBlockCommit(MemBankBlock(blockIdx));
+    else
+        blockIdx = MemBankAddBlock(arena->numBlocks, node);
+
+    /* None of the block's slots are handed out through its free list. */
+    MemBlock* block = MemBankBlock(blockIdx);
+    block->freeCount = 0;
+    block->highWater = block->cap;
+    block->firstFree = FreeHead(FreeHeadTag(block->firstFree) + 1, 0);
+    arena->thunks = block->thunks;
+    arena->next = 0;
+    arena->cap = block->cap;
+#ifdef THREAD_PTHREADS
+    pthread_rwlock_unlock(&bank.lock);
+    pthread_setcancelstate(origCancelState, &origCancelState);
+#endif
+
+    arena->blocks[arena->numBlocks++] = blockIdx;
+
+    return;
+}
+
+static void MemArenaRelease(CClosureArena* arena) {
+#ifdef THREAD_PTHREADS
+    int32_t origCancelState;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &origCancelState);
+    MemBankLock(pthread_rwlock_trywrlock, pthread_rwlock_wrlock);
+#endif
+    /* Dropping the pages uninitializes every closure at once; the blocks are
+     * formatted again when next needed. */
+    for (size_t idx = 0; idx < arena->numBlocks; idx++)
+        MemBankDecommit(arena->blocks[idx]);
+#ifdef THREAD_PTHREADS
+    pthread_rwlock_unlock(&bank.lock);
+    pthread_setcancelstate(origCancelState, &origCancelState);
+#endif
+
+    return;
+}
+
+#ifdef THREAD_PTHREADS
+static MemReader* MemReaderAcquire(void) {
+    for (MemReader* reader = __atomic_load_n(&readers, __ATOMIC_ACQUIRE);
+         reader != NULL; reader = reader->next) {
+        bool inUse = false;
+        if (__atomic_compare_exchange_n(&reader->inUse, &inUse, true, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return reader;
+    }
+
+    /* Running without a reader would let slots be reused under this thread's
+     * queries, so fail closed. */
+    MemReader* reader = calloc(1, sizeof(MemReader));
+    if (reader == NULL)
+        abort();
+    reader->inUse = true;
+    reader->next = __atomic_load_n(&readers, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&readers, &reader->next, reader, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        continue;
+
+    return reader;
+}
+
+static size_t MemEpochReclaim(MemMag* curMag, Closure** safe) {
+    /* Advance the epoch so that readers entering from now on no longer hold
+     * back anything retired so far. */
+    __atomic_fetch_add(&globalEpoch, 1, __ATOMIC_SEQ_CST);
+    uint64_t oldest = UINT64_MAX;
+    for (MemReader* reader = __atomic_load_n(&readers, __ATOMIC_ACQUIRE);
+         reader != NULL; reader = reader->next) {
+        uint64_t epoch = __atomic_load_n(&reader->epoch, __ATOMIC_SEQ_CST);
+        if (epoch != 0 && epoch < oldest)
+            oldest = epoch;
+    }
+
+    /* Collect whatever no active reader may still observe. */
+    size_t numSafe = 0;
+    size_t numKept = 0;
+    for (size_t idx = 0; idx < curMag->limboSize; idx++) {
+        if (curMag->limbo[idx].epoch < oldest)
+            safe[numSafe++] = curMag->limbo[idx].slot;
+        else
+            curMag->limbo[numKept++] = curMag->limbo[idx];
+    }
+    curMag->limboSize = numKept;
+
+    return numSafe;
+}
+
+static void MemMagFlush(void* localMag) {
+    MemMag* curMag = localMag;
+
+    /* Readers only hold the epoch back for the length of a getter. */
+    while (curMag->limboSize > 0) {
+        Closure* safe[LIMBO_CAP];
+        size_t numSafe = MemEpochReclaim(curMag, safe);
+        if (numSafe > 0)
+            MemBankRelease(safe, numSafe);
+        else
+            sched_yield();
+    }
+    MemBankRelease(curMag->slots, curMag->size);
+    curMag->size = 0;
+    curMag->registered = false;
+    __atomic_store_n(&curMag->reader->inUse, false, __ATOMIC_RELEASE);
+    curMag->reader = NULL;
+
+    /* Keep the exiting thread's counters once its magazine is gone. */
+    pthread_mutex_lock(&statsLock);
+    for (MemMag** link = &magList; *link != NULL; link = &(*link)->next) {
+        if (*link == curMag) {
+            *link = curMag->next;
+            break;
+        }
+    }
+    retiredStats.created += curMag->stats.created;
+    retiredStats.freed += curMag->stats.freed;
+    retiredStats.lockContended += curMag->stats.lockContended;
+    retiredStats.lockWaitNs += curMag->stats.lockWaitNs;
+    curMag->stats = (MemStats){0};
+    pthread_mutex_unlock(&statsLock);
+
+    return;
+}
+
+static void MemMagRegisterSlow(void) {
+    pthread_setspecific(magKey, &mag);
+    mag.reader = MemReaderAcquire();
+    pthread_mutex_lock(&statsLock);
+    mag.next = magList;
+    magList = &mag;
+    pthread_mutex_unlock(&statsLock);
+    mag.registered = true;
+
+    return;
+}
+
+static inline void MemMagRegister(void) {
+    /* Ensure that cached slots are returned to the bank on thread exit, and
+     * that this thread's counters are visible to CClosureGetStats. */
+    if (!mag.registered)
+        MemMagRegisterSlow();
+
+    return;
+}
+
+static inline void MemEpochEnter(void) {
+    MemMagRegister();
+    /* The epoch may advance between loading and publishing it, in which case
+     * a reclaimer could already have skipped this reader, so publish again
+     * until what was published is still current. */
+    uint64_t epoch = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+    for (;;) {
+        __atomic_store_n(&mag.reader->epoch, epoch, __ATOMIC_SEQ_CST);
+        uint64_t current = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+        if (current == epoch)
+            break;
+        epoch = current;
+    }
+
+    return;
+}
+
+static inline void MemEpochExit(void) {
+    __atomic_store_n(&mag.reader->epoch, 0, __ATOMIC_RELEASE);
+
+    return;
+}
+#endif
+
+static Closure* MemMagPop(void) {
+    if (mag.size == 0) {
+#ifdef THREAD_PTHREADS
+        MemMagRegister();
+#endif
+        MemBankClaim(mag.slots, MAG_BATCH);
+        mag.size = MAG_BATCH;
+    }
+    MemStatAdd(created, 1);
+
+    return mag.slots[--mag.size];
+}
+
+#ifndef THREAD_PTHREADS
+static void MemMagPush(Closure* slot) {
+    if (mag.size == MAG_CAP) {
+        /* Return the least recently freed slots, keeping hot ones cached. */
+        MemBankRelease(mag.slots, MAG_BATCH);
+        memmove(mag.slots, mag.slots + MAG_BATCH,
+                (MAG_CAP - MAG_BATCH) * sizeof(Closure*));
+        mag.size -= MAG_BATCH;
+    }
+    mag.slots[mag.size++] = slot;
+
+    return;
+}
+#endif
+
+static void MemMagPopBatch(Closure** slots, size_t num) {
+    /* Serve what the magazine holds and claim the rest from the bank at once. */
+#ifdef THREAD_PTHREADS
+    MemMagRegister();
+#endif
+    MemStatAdd(created, num);
+    size_t fromMag = (num < mag.size) ? num : mag.size;
+    mag.size -= fromMag;
+    memcpy(slots, mag.slots + mag.size, fromMag * sizeof(Closure*));
+    if (fromMag < num)
+        MemBankClaim(slots + fromMag, num - fromMag);
+
+    return;
+}
+
+static void MemMagPushBatch(Closure* const* slots, size_t num) {
+    /* Cache what fits in the magazine and release the rest to the bank. */
+#ifdef THREAD_PTHREADS
+    MemMagRegister();
+#endif
+    size_t toMag = MAG_CAP - mag.size;
+    if (toMag > num)
+        toMag = num;
+    if (toMag > 0) {
+        memcpy(mag.slots + mag.size, slots, toMag * sizeof(Closure*));
+        mag.size += toMag;
+    }
+    if (toMag < num)
+        MemBankRelease(slots + toMag, num - toMag);
+
+    return;
+}
+
+static void MemMagRetireBatch(Closure* const* slots, size_t num) {
+    /* Freed slots sit in limbo until no getter can still be reading them. */
+    MemStatAdd(freed, num);
+#ifdef THREAD_PTHREADS
+    MemMagRegister();
+    for (size_t idx = 0; idx < num; idx++) {
+        while (mag.limboSize == LIMBO_CAP) {
+            Closure* safe[LIMBO_CAP];
+            size_t numSafe = MemEpochReclaim(&mag, safe);
+            if (numSafe > 0)
+                MemMagPushBatch(safe, numSafe);
+            else
+                sched_yield();
+        }
+        mag.limbo[mag.limboSize++] = (MemRetired){
+            .slot = slots[idx],
+            .epoch = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST)};
+    }
+#else
+    MemMagPushBatch(slots, num);
+#endif
+
+    return;
+}
+
+static void MemMagRetire(Closure* slot) {
+#ifdef THREAD_PTHREADS
+    MemMagRetireBatch(&slot, 1);
+#else
+    MemStatAdd(freed, 1);
+    MemMagPush(slot);
+#endif
+
+    return;
+}
+
+#ifdef STATIC_TRAMPOLINES
+static void ClosureInit(Closure* clos, void* fcn, void* env, bool aggRet) {
+    TrampData* data = TrampData(clos);
+    data->env = env;
+    data->fcn = fcn;
+    __atomic_store_n(&data->stub, (aggRet) ? CClosureTrampAgg : CClosureTrampNorm,
+                     __ATOMIC_RELEASE);
+
+    return;
+}
+
+#ifdef __LP64__
+static void ClosureInitArgs(Closure* clos,
+                            void* fcn,
+                            void* env,
+                            size_t nIntArgs) {
+    TrampData* data = TrampData(clos);
+    data->env = env;
+    data->fcn = fcn;
+    __atomic_store_n(&data->stub, TRAMP_ARGS[nIntArgs], __ATOMIC_RELEASE);
+
+    return;
+}
+
+static void ClosureInitBind(Closure* clos,
+                            void* fcn,
+                            size_t n,
+                            const uintptr_t* values) {
+    uintptr_t* bound = (uintptr_t*)MemInlineEnv(clos);
+    memcpy(bound, values + 1, (n - 1) * sizeof(uintptr_t));
+    TrampData* data = TrampData(clos);
+    data->env = (void*)values[0];
+    data->fcn = fcn;
+    data->bound = bound;
+    __atomic_store_n(&data->stub, TRAMP_BIND[n - 2], __ATOMIC_RELEASE);
+
+    return;
+}
+#endif
+
+static void* ClosureGetEnv(Closure* clos) {
+    return __atomic_load_n(&TrampData(clos)->env, __ATOMIC_RELAXED);
+}
+
+static void* ClosureGetFcn(Closure* clos) {
+    return __atomic_load_n(&TrampData(clos)->fcn, __ATOMIC_RELAXED);
+}
+
+static void* ClosureSetEnv(Closure* clos, void* env) {
+    return __atomic_exchange_n(&TrampData(clos)->env, env, __ATOMIC_ACQ_REL);
+}
+
+static void* ClosureSetFcn(Closure* clos, void* fcn) {
+    return __atomic_exchange_n(&TrampData(clos)->fcn, fcn, __ATOMIC_ACQ_REL);
+}
+
+static void* ClosureDeinit(Closure* clos) {
+    TrampData* data = TrampData(clos);
+    __atomic_store_n(&data->stub, CClosureTrampUninit, __ATOMIC_RELAXED);
+
+    return data->env;
+}
+#else
+static void ClosureWriteHead(Closure* clos,
+                             const uint8_t* head,
+                             void* fcn,
+                             void* env) {
+    /* Written a word at a time and leading instruction last, so that a getter
+     * racing with reuse of a freed slot never reads a half-written binding. */
+    uintptr_t words[THUNK_ENTRY_SIZE / sizeof(uintptr_t)];
+    memcpy(words, head, THUNK_ENTRY_SIZE);
+    words[offsetof(Closure, entry.tmpl.norm.env) / sizeof(uintptr_t)] =
+        (uintptr_t)env;
+    words[offsetof(Closure, entry.tmpl.norm.fcn) / sizeof(uintptr_t)] =
+        (uintptr_t)fcn;
+    uintptr_t* bin = (uintptr_t*)((uint8_t*)clos + offsetof(Closure, entry));
+    for (size_t idx = THUNK_ENTRY_SIZE / sizeof(uintptr_t) - 1; idx > 0; idx--)
+        __atomic_store_n(bin + idx, words[idx], __ATOMIC_RELAXED);
+    __atomic_store_n(bin, words[0], __ATOMIC_RELEASE);
+
+    return;
+}
+
+static void ClosureInit(Closure* clos, void* fcn, void* env, bool aggRet) {
+#ifdef __LP64__
+    /* Thunks of other kinds overwrite the jump, so it is written anew. */
+    uint8_t jump[THUNK_JUMP_SIZE];
+    memcpy(jump, THUNK_JUMP, THUNK_JUMP_SIZE);
+    int32_t rel = ClosureExitStub(clos) - (clos->jump + THUNK_JUMP_SIZE);
+    memcpy(jump + 1, &rel, sizeof(rel));
+    memcpy(clos->jump, jump, THUNK_JUMP_SIZE);
+#endif
+    ClosureWriteHead(clos, (aggRet) ? THUNK_ENTRY_AGG : THUNK_ENTRY_NORM, fcn,
+                     env);
+
+    return;
+}
+
+#ifdef __LP64__
+static void ClosureInitArgs(Closure* clos,
+                            void* fcn,
+                            void* env,
+                            size_t nIntArgs) {
+    /* Only the registers holding arguments are shifted up to make room. */
+    uint8_t* bin = clos->args.bin + THUNK_ARGS_HEAD_SIZE;
+    size_t shiftSize = nIntArgs * THUNK_ARGS_SHIFT_SIZE;
+    memcpy(bin, THUNK_ARGS_SHIFT + sizeof(THUNK_ARGS_SHIFT) - shiftSize,
+           shiftSize);
+    bin += shiftSize;
+    memcpy(bin, THUNK_ARGS_TAIL, THUNK_ARGS_TAIL_SIZE);
+    ClosureWriteHead(clos, THUNK_ARGS_HEAD, fcn, env);
+
+    return;
+}
+
+static void ClosureInitBind(Closure* clos,
+                            void* fcn,
+                            size_t n,
+                            const uintptr_t* values) {
+    const uint8_t* tmpl = THUNK_BIND[n - 2];
+    memcpy(clos->args.bind + THUNK_ARGS_HEAD_SIZE, tmpl + THUNK_ARGS_HEAD_SIZE,
+           THUNK_BIND_SIZE - THUNK_ARGS_HEAD_SIZE);
+    for (size_t idx = 1; idx < n; idx++)
+        memcpy(clos->args.bind + THUNK_BIND_VALS[n - 2][idx - 1], values + idx,
+               sizeof(uintptr_t));
+    ClosureWriteHead(clos, tmpl, fcn, (void*)values[0]);
+
+    return;
+}
+#endif
+
+/* Every thunk keeps its immediates naturally aligned, so that they may be
+ * loaded and stored atomically even while the thunk is being executed. */
+static void** ClosureEnvImm(Closure* clos) {
+#ifdef __LP64__
+    if (IsArgs(clos))
+        return (void**)((uint8_t*)clos + offsetof(Closure, args.tmpl.env));
+#endif
+
+    return (void**)((uint8_t*)clos + offsetof(Closure, entry.tmpl.norm.env));
+}
+
+static void** ClosureFcnImm(Closure* clos) {
+#ifdef __LP64__
+    if (IsArgs(clos))
+        return (void**)((uint8_t*)clos + offsetof(Closure, args.tmpl.fcn));
+#endif
+
+    return (void**)((uint8_t*)clos + offsetof(Closure, entry.tmpl.norm.fcn));
+}
+
+static void* ClosureGetEnv(Closure* clos) {
+    return __atomic_load_n(ClosureEnvImm(clos), __ATOMIC_RELAXED);
+}
+
+static void* ClosureGetFcn(Closure* clos) {
+    return __atomic_load_n(ClosureFcnImm(clos), __ATOMIC_RELAXED);
+}
+
+static void* ClosureSetEnv(Closure* clos, void* env) {
+    return __atomic_exchange_n(ClosureEnvImm(clos), env, __ATOMIC_ACQ_REL);
+}
+
+static void* ClosureSetFcn(Closure* clos, void* fcn) {
+    return __atomic_exchange_n(ClosureFcnImm(clos), fcn, __ATOMIC_ACQ_REL);
+}
+
+static void* ClosureDeinit(Closure* clos) {
+    void* env = ClosureGetEnv(clos);
+    /* Only the leading instruction is replaced, with a single atomic store, so
+     * that concurrent getters still read the last binding intact. */
+    uint16_t trap;
+    memcpy(&trap, THUNK_ENTRY_UNINIT + THUNK_ENTRY_SIZE - 2, sizeof(trap));
+    __atomic_store_n((uint16_t*)clos->entry.bin, trap, __ATOMIC_RELEASE);
+
+    return env;
+}
+#endif
+
+__attribute__((constructor)) static void Constructor(void) {
+#ifdef THREAD_PTHREADS
+    pthread_rwlock_init(&bank.lock, NULL);
+    pthread_key_create(&magKey, MemMagFlush);
+#endif
+    bank.size = 0;
+
+    return;
+}
+
+__attribute__((destructor)) static void Destructor(void) {
+#ifdef THREAD_PTHREADS
+    pthread_key_delete(magKey);
+#endif
+    for (size_t idx = 0; idx < bank.size; idx++)
+        MemBlockDeinit(MemBankBlock(idx));
+    for (size_t idx = 0; idx < AvailWords(bank.size); idx++)
+        free(bank.dir[idx]);
+    for (size_t top = 0; top < (size_t)1 << INDEX_TOP_BITS; top++) {
+        if (bank.index[top] == NULL)
+            continue;
+        for (size_t mid = 0; mid < (size_t)1 << INDEX_MID_BITS; mid++)
+            free(bank.index[top]->leaves[mid]);
+        free(bank.index[top]);
+        bank.index[top] = NULL;
+    }
+#ifdef THREAD_PTHREADS
+    pthread_rwlock_destroy(&bank.lock);
+    while (readers != NULL) {
+        MemReader* next = readers->next;
+        free(readers);
+        readers = next;
+    }
+    mag.reader = NULL;
+    mag.limboSize = 0;
+#endif
+#ifdef STATIC_TRAMPOLINES
+    if (trampFd >= 0)
+        close(trampFd);
+    trampFd = -1;
+#endif
+    bank = (MemBank){0};
+    mag.size = 0;
+
+    return;
+}
+
+/* ----- PUBLIC FUNCTIONS ----- */
+
+CCLOSURE_EXPORT void* CClosureNew(void* fcn, void* env, bool aggRet) {
+    /* Consume free slot. */
+    Closure* slot = MemMagPop();
+
+    /* Initialize closure entry. */
+    Closure* clos = (Closure*)slot;
+    ClosureInit(clos, fcn, env, aggRet);
+    Trace(closure__new, clos, fcn, env);
+
+    return clos;
+}
+
+CCLOSURE_EXPORT void* CClosureNewArgs(void* fcn, void* env, size_t nIntArgs) {
+#ifdef __LP64__
+    if (nIntArgs > CCLOSURE_MAX_INT_ARGS)
+        return NULL;
+
+    /* Consume free slot. */
+    Closure* clos = MemMagPop();
+
+    /* Initialize closure entry. */
+    ClosureInitArgs(clos, fcn, env, nIntArgs);
+    Trace(closure__new, clos, fcn, env);
+
+    return clos;
+#else
+    /* cdecl passes every argument on the stack, so there is no register to
+     * shift env into without unbalancing the caller's stack. */
+    (void)fcn;
+    (void)env;
+    (void)nIntArgs;
+
+    return NULL;
+#endif
+}
+
+CCLOSURE_EXPORT void* CClosureBind(void* fcn,
+                                   size_t n,
+                                   const uintptr_t* values) {
+#ifdef __LP64__
+    if (n == 0 || n > CCLOSURE_MAX_BIND_ARGS)
+        return NULL;
+
+    /* Consume free slot. */
+    Closure* clos = MemMagPop();
+
+    /* Initialize closure entry. A single value is just an environment. */
+    if (n == 1)
+        ClosureInitArgs(clos, fcn, (void*)values[0], CCLOSURE_MAX_INT_ARGS);
+    else
+        ClosureInitBind(clos, fcn, n, values);
+    Trace(closure__new, clos, fcn, (void*)values[0]);
+
+    return clos;
+#else
+    (void)fcn;
+    (void)n;
+    (void)values;
+
+    return NULL;
+#endif
+}
+
+CCLOSURE_EXPORT void* CClosureNewInline(void* fcn,
+                                        const void* env,
+                                        size_t size,
+                                        bool aggRet) {
+    if (size > INLINE_ENV_SIZE)
+        return NULL;
+
+    /* Consume free slot. */
+    Closure* clos = MemMagPop();
+
+    /* Copy environment into the slot's own storage. */
+    uint8_t* inlineEnv = MemInlineEnv(clos);
+    if (size > 0)
+        memcpy(inlineEnv, env, size);
+
+    /* Initialize closure entry. */
+    ClosureInit(clos, fcn, inlineEnv, aggRet);
+    Trace(closure__new, clos, fcn, inlineEnv);
+
+    return clos;
+}
+
+CCLOSURE_EXPORT void CClosureNewBatch(void* const* fcns,
+                                      void* const* envs,
+                                      const bool* aggRets,
+                                      void** out,
+                                      size_t num) {
+    Closure* slots[BATCH_CHUNK];
+    for (size_t base = 0; base < num; base += BATCH_CHUNK) {
+        size_t chunk = (num - base < BATCH_CHUNK) ? num - base : BATCH_CHUNK;
+
+        /* Consume free slots. */
+        MemMagPopBatch(slots, chunk);
+
+        /* Initialize closure entries. */
+        for (size_t idx = 0; idx < chunk; idx++) {
+            size_t pos = base + idx;
+            void* env = (envs != NULL) ? envs[pos] : NULL;
+            ClosureInit(slots[idx], fcns[pos], env,
+                        (aggRets != NULL) ? aggRets[pos] : false);
+            out[pos] = slots[idx];
+            Trace(closure__new, slots[idx], fcns[pos], env);
+        }
+    }
+
+    return;
+}
+
+CCLOSURE_EXPORT void* CClosureFree(void* clos) {
+#define clos ((Closure*)clos)
+    /* Deinitialize closure entry. */
+    void* env = ClosureDeinit(clos);
+    Trace(closure__free, clos, env);
+
+    /* Release free slot. */
+    MemMagRetire(clos);
+
+    return env;
+#undef clos
+}
+
+CCLOSURE_EXPORT void CClosureFreeBatch(void* const* closures,
+                                       void** envsOut,
+                                       size_t num) {
+    Closure* slots[BATCH_CHUNK];
+    for (size_t base = 0; base < num; base += BATCH_CHUNK) {
+        size_t chunk = (num - base < BATCH_CHUNK) ? num - base : BATCH_CHUNK;
+
+        /* Deinitialize closure entries. */
+        for (size_t idx = 0; idx < chunk; idx++) {
+            size_t pos = base + idx;
+            void* env = ClosureDeinit(closures[pos]);
+            Trace(closure__free, closures[pos], env);
+            if (envsOut != NULL)
+                envsOut[pos] = env;
+            slots[idx] = closures[pos];
+        }
+
+        /* Release free slots. */
+        MemMagRetireBatch(slots, chunk);
+    }
+
+    return;
+}
+
+CCLOSURE_EXPORT bool CClosureReserve(size_t num) {
+    return MemBankReserve(num);
+}
+
+CCLOSURE_EXPORT CClosureArena* CClosureArenaCreate(void) {
+#ifdef THREAD_PTHREADS
+    MemMagRegister();
+#endif
+    CClosureArena* arena = calloc(1, sizeof(CClosureArena));
+    if (arena == NULL)
+        abort();
+
+    return arena;
+}
+
+CCLOSURE_EXPORT void* CClosureArenaNew(CClosureArena* arena,
+                                       void* fcn,
+                                       void* env,
+                                       bool aggRet) {
+    /* Consume the next slot of the current block. */
+    if (arena->next == arena->cap)
+        MemArenaGrow(arena);
+    Closure* clos = MemThunkAt(arena->thunks, arena->next++);
+    arena->count++;
+    MemStatAdd(created, 1);
+
+    /* Initialize closure entry. */
+    ClosureFormat(clos);
+    ClosureInit(clos, fcn, env, aggRet);
+    Trace(closure__new, clos, fcn, env);
+
+    return clos;
+}
+
+CCLOSURE_EXPORT void CClosureArenaDestroy(CClosureArena* arena) {
+    MemArenaRelease(arena);
+    MemStatAdd(freed, arena->count);
+    Trace(arena__destroy, arena->count, arena->numBlocks);
+    free(arena->blocks);
+    free(arena);
+
+    return;
+}
+
+CCLOSURE_EXPORT CClosurePool* CClosurePoolCreate(void) {
+#ifdef THREAD_PTHREADS
+    MemMagRegister();
+#endif
+    CClosurePool* pool = calloc(1, sizeof(CClosurePool));
+    if (pool == NULL)
+        abort();
+
+    return pool;
+}
+
+CCLOSURE_EXPORT void* CClosurePoolNew(CClosurePool* pool,
+                                      void* fcn,
+                                      void* env,
+                                      bool aggRet) {
+    /* Reuse the most recently freed slot, or else consume the next slot of
+     * the current block. Only the latter ever touches the bank. */
+    Closure* clos;
+    if (pool->numFree > 0) {
+        clos = pool->free[--pool->numFree];
+    } else {
+        CClosureArena* arena = &pool->arena;
+        if (arena->next == arena->cap)
+            MemArenaGrow(arena);
+        clos = MemThunkAt(arena->thunks, arena->next++);
+        arena->count++;
+        ClosureFormat(clos);
+    }
+    MemStatAdd(created, 1);
+
+    /* Initialize closure entry. */
+    ClosureInit(clos, fcn, env, aggRet);
+    Trace(closure__new, clos, fcn, env);
+
+    return clos;
+}
+
+CCLOSURE_EXPORT void* CClosurePoolFree(CClosurePool* pool, void* clos) {
 #define clos ((Closure*)clos)
-    return (IsAggRet(clos)) ? clos->entry.tmpl.agg.env
-                            : clos->entry.tmpl.norm.env;
+    /* Deinitialize closure entry. */
+    void* env = ClosureDeinit(clos);
+    Trace(closure__free, clos, env);
+    MemStatAdd(freed, 1);
+
+    /* Keep free slot for the pool's next closure. */
+    if (pool->numFree == pool->freeCap) {
+        size_t freeCap = (pool->freeCap == 0) ? MAG_CAP : pool->freeCap * 2;
+        Closure** slots = realloc(pool->free, freeCap * sizeof(Closure*));
+        if (slots == NULL)
+            abort();
+        pool->free = slots;
+        pool->freeCap = freeCap;
+    }
+    pool->free[pool->numFree++] = clos;
+
+    return env;
 #undef clos
+}
+
+CCLOSURE_EXPORT void CClosurePoolDestroy(CClosurePool* pool) {
+    size_t live = pool->arena.count - pool->numFree;
+    MemArenaRelease(&pool->arena);
+    MemStatAdd(freed, live);
+    Trace(arena__destroy, pool->arena.count, pool->arena.numBlocks);
+    free(pool->arena.blocks);
+    free(pool->free);
+    free(pool);
+
+    return;
+}
+
+CCLOSURE_EXPORT bool CClosureCheck(void* clos) {
+    size_t blockIdx = MemIndexFind(clos);
+    if (blockIdx == INDEX_NONE)
+        return false;
+    uintptr_t start = (uintptr_t)MemBankBlock(blockIdx)->thunks;
+#ifdef STATIC_TRAMPOLINES
+    /* Only trampoline entry points count, not their data or padding. */
+    size_t offset = (uintptr_t)clos - start;
+    if (offset % (TRAMP_TABLE_SIZE * 2) >= TRAMP_TABLE_SIZE ||
+        offset % TRAMP_SIZE != 0)
+        return false;
+#else
+    /* Only thunk entry points count, not their insides or a page's tail. */
+    size_t offset = ((uintptr_t)clos - start) % THUNK_PAGE_SIZE;
+    if (offset % sizeof(Closure) != 0 ||
+        offset / sizeof(Closure) >= THUNKS_PER_PAGE)
+        return false;
+#endif
+
+    return IsInit(((Closure*)clos));
+}
+
+CCLOSURE_EXPORT void* CClosureGetFcn(void* clos) {
+#ifdef THREAD_PTHREADS
+    MemEpochEnter();
+#endif
+    void* fcn = ClosureGetFcn(clos);
+#ifdef THREAD_PTHREADS
+    MemEpochExit();
+#endif
+
+    return fcn;
+}
+
+CCLOSURE_EXPORT void* CClosureGetEnv(void* clos) {
+#ifdef THREAD_PTHREADS
+    MemEpochEnter();
+#endif
+    void* env = ClosureGetEnv(clos);
+#ifdef THREAD_PTHREADS
+    MemEpochExit();
+#endif
+
+    return env;
+}
+
+CCLOSURE_EXPORT void* CClosureSetFcn(void* clos, void* fcn) {
+    return ClosureSetFcn(clos, fcn);
+}
+
+CCLOSURE_EXPORT void* CClosureSetEnv(void* clos, void* env) {
+    return ClosureSetEnv(clos, env);
+}
+
+CCLOSURE_EXPORT void CClosureGetStats(CClosureStats* stats) {
+    /* Sum the per-thread counters. */
+    MemStats sum;
+#ifdef THREAD_PTHREADS
+    pthread_mutex_lock(&statsLock);
+    sum = retiredStats;
+    for (MemMag* curMag = magList; curMag != NULL; curMag = curMag->next) {
+        sum.created += __atomic_load_n(&curMag->stats.created, __ATOMIC_RELAXED);
+        sum.freed += __atomic_load_n(&curMag->stats.freed, __ATOMIC_RELAXED);
+        sum.lockContended +=
+            __atomic_load_n(&curMag->stats.lockContended, __ATOMIC_RELAXED);
+        sum.lockWaitNs +=
+            __atomic_load_n(&curMag->stats.lockWaitNs, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&statsLock);
+#else
+    sum = mag.stats;
+#endif
+
+    /* Describe the bank itself. */
+    *stats = (CClosureStats){0};
+#ifdef THREAD_PTHREADS
+    pthread_rwlock_rdlock(&bank.lock);
+#endif
+    for (size_t idx = 0; idx < bank.size; idx++) {
+        MemBlock* block = MemBankBlock(idx);
+        stats->mappedBytes += block->rawSize;
+        if (block->committed) {
+            stats->committedBlocks++;
+            stats->committedBytes += block->rawSize;
+        }
+    }
+    stats->numBlocks = bank.size;
+    stats->numGrows = bank.grows;
+#ifdef THREAD_PTHREADS
+    pthread_rwlock_unlock(&bank.lock);
+#endif
+
+    /* Threads keep running while their counters are summed, so a free may be
+     * seen without the matching creation. */
+    stats->liveClosures =
+        (sum.created > sum.freed) ? (size_t)(sum.created - sum.freed) : 0;
+    stats->numCreated = sum.created;
+    stats->numFreed = sum.freed;
+    stats->lockContended = sum.lockContended;
+    stats->lockWaitNs = sum.lockWaitNs;
+
+    return;
 }
\ No newline at end of file
@@ -0,0 +1,78 @@
+/* Verify that closures created in an arena work like any other closure, and
+ * that destroying the arena destroys all of them. */
+
+#include "test_prelude.h"
+
+typedef struct Doohickey {
+    int64_t a;
+    int64_t b;
+    int64_t c;
+} Doohickey;
+
+#define NUM_CLOSURES ((size_t)20000)
+static void* closures[NUM_CLOSURES] = {0};
+
+static int64_t CallbackNorm(CClosureCtx ctx, int64_t val) {
+    return (int64_t)(intptr_t)ctx.env + val;
+}
+
+static Doohickey CallbackAgg(CClosureCtx ctx) {
+    int64_t val = (int64_t)(intptr_t)ctx.env;
+
+    return (Doohickey){.a = val, .b = -val, .c = val * 2};
+}
+
+static void FillArena(CClosureArena* arena) {
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        void* env = (void*)(intptr_t)idx;
+        closures[idx] = (idx % 2 == 0)
+                            ? CClosureArenaNew(arena, CallbackNorm, env, false)
+                            : CClosureArenaNew(arena, CallbackAgg, env, true);
+    }
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        AssertBoolEqual(CClosureCheck(closures[idx]), true);
+        AssertIs(CClosureGetEnv(closures[idx]), (void*)(intptr_t)idx);
+        if (idx % 2 == 0) {
+            int64_t (*clos)(int64_t) = closures[idx];
+            AssertIntEqual(clos(3), (int64_t)idx + 3);
+        } else {
+            Doohickey (*clos)(void) = closures[idx];
+            AssertIntEqual(clos().c, (int64_t)idx * 2);
+        }
+    }
+
+    return;
+}
+
+TestCase {
+    CClosureArena* arena = CClosureArenaCreate();
+    FillArena(arena);
+    CClosureArenaDestroy(arena);
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++)
+        AssertBoolEqual(CClosureCheck(closures[idx]), false);
+
+    /* Released blocks are picked up again by later arenas... */
+    CClosureStats before;
+    CClosureGetStats(&before);
+    arena = CClosureArenaCreate();
+    FillArena(arena);
+    CClosureStats during;
+    CClosureGetStats(&during);
+    AssertIntEqual((uint64_t)during.numBlocks, (uint64_t)before.numBlocks);
+    CClosureArenaDestroy(arena);
+
+    /* ...and by ordinary closures. */
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        closures[idx] =
+            CClosureNew(CallbackNorm, (void*)(intptr_t)idx, false);
+        AssertIntEqual(((int64_t(*)(int64_t))closures[idx])(1),
+                       (int64_t)idx + 1);
+    }
+    CClosureFreeBatch(closures, NULL, NUM_CLOSURES);
+
+    CClosureStats after;
+    CClosureGetStats(&after);
+    AssertIntEqual((uint64_t)after.liveClosures, (uint64_t)0);
+
+    Pass();
+}
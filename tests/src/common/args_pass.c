@@ -0,0 +1,104 @@
+/* Verify that closures created using CClosureNewArgs receive their environment
+ * as a leading argument followed by every argument they were called with. */
+
+#include "test_prelude.h"
+
+static int64_t CallbackCtx(CClosureCtx ctx, int64_t a) {
+    return *(int64_t*)ctx.env - a;
+}
+
+typedef struct SelfFree {
+    void* self;
+    void* reused;
+} SelfFree;
+
+static int64_t Callback0(void* env);
+
+static int64_t CallbackSelfFree(CClosureCtx ctx, int64_t a) {
+    /* Free this closure and take its slot back as another kind of closure
+     * before returning through it. */
+    SelfFree* state = ctx.env;
+    CClosureFree(state->self);
+    for (size_t idx = 0; idx < 1024 && state->reused != state->self; idx++) {
+        if (state->reused != NULL)
+            CClosureFree(state->reused);
+        state->reused = CClosureNewArgs(Callback0, &state->self, 0);
+    }
+
+    return a * 2;
+}
+
+static int64_t Callback0(void* env) {
+    return *(int64_t*)env;
+}
+
+static int64_t Callback2(void* env, int64_t a, double x, int64_t b) {
+    return *(int64_t*)env + a * 10 + b * 100 + (int64_t)x;
+}
+
+static int64_t Callback5(void* env,
+                         int64_t a,
+                         int64_t b,
+                         double x,
+                         int64_t c,
+                         int64_t d,
+                         int64_t e,
+                         double y) {
+    return *(int64_t*)env + a + b * 10 + c * 100 + d * 1000 + e * 10000 +
+           (int64_t)(x * y);
+}
+
+TestCase {
+    int64_t env = 7;
+
+    AssertIs(CClosureNewArgs(Callback5, &env, CCLOSURE_MAX_INT_ARGS + 1),
+             NULL);
+#ifdef __x86_64__
+    int64_t (*clos0)(void) = CClosureNewArgs(Callback0, &env, 0);
+    int64_t (*clos2)(int64_t, double, int64_t) =
+        CClosureNewArgs(Callback2, &env, 2);
+    int64_t (*clos5)(int64_t, int64_t, double, int64_t, int64_t, int64_t,
+                     double) = CClosureNewArgs(Callback5, &env, 5);
+
+    AssertBoolEqual(CClosureCheck(clos0), true);
+    AssertBoolEqual(CClosureCheck(clos2), true);
+    AssertBoolEqual(CClosureCheck(clos5), true);
+    AssertIs(CClosureGetFcn(clos2), Callback2);
+    AssertIs(CClosureGetEnv(clos2), &env);
+
+    AssertIntEqual(clos0(), (int64_t)7);
+    AssertIntEqual(clos2(1, 20000.0, 2), (int64_t)20217);
+    AssertIntEqual(clos5(1, 2, 3.0, 3, 4, 5, 1000.0), (int64_t)57328);
+
+    AssertIs(CClosureFree(clos0), &env);
+    AssertIs(CClosureFree(clos2), &env);
+    AssertIs(CClosureFree(clos5), &env);
+    AssertBoolEqual(CClosureCheck(clos5), false);
+
+    /* Freed slots must work as ordinary closures again. Slots are only reused
+     * once it is safe to do so, so keep churning until it comes back. */
+    int64_t (*clos)(int64_t) = NULL;
+    for (size_t idx = 0; idx < 1024 && (void*)clos != (void*)clos5; idx++) {
+        if (clos != NULL)
+            CClosureFree(clos);
+        clos = CClosureNew(CallbackCtx, &env, false);
+        AssertIntEqual(clos(3), (int64_t)4);
+    }
+    AssertIs(clos, clos5);
+    CClosureFree(clos);
+
+    /* A closure that frees itself must still return if its slot is reused
+     * before it does. */
+    SelfFree state = {NULL, NULL};
+    clos = CClosureNew(CallbackSelfFree, &state, false);
+    state.self = clos;
+    AssertIntEqual(clos(21), (int64_t)42);
+    AssertIs(state.reused, state.self);
+    AssertIntEqual(((int64_t(*)(void))state.reused)(), (int64_t)(intptr_t)clos);
+    CClosureFree(state.reused);
+#else
+    AssertIs(CClosureNewArgs(Callback0, &env, 0), NULL);
+#endif
+
+    Pass();
+}
@@ -0,0 +1,67 @@
+/* Verify that CClosureNewBatch and CClosureFreeBatch create and destroy
+ * closures equivalent to those of CClosureNew and CClosureFree. */
+
+#include "test_prelude.h"
+
+typedef struct Doohickey {
+    int64_t a;
+    int64_t b;
+    int64_t c;
+} Doohickey;
+
+#define NUM_CLOSURES ((size_t)1000)
+static void* fcns[NUM_CLOSURES] = {0};
+static void* envs[NUM_CLOSURES] = {0};
+static bool aggRets[NUM_CLOSURES] = {0};
+static void* closures[NUM_CLOSURES] = {0};
+static void* envsOut[NUM_CLOSURES] = {0};
+static int64_t values[NUM_CLOSURES] = {0};
+
+static int64_t CallbackNorm(CClosureCtx ctx) {
+    return *(int64_t*)ctx.env;
+}
+
+static Doohickey CallbackAgg(CClosureCtx ctx) {
+    int64_t val = *(int64_t*)ctx.env;
+
+    return (Doohickey){.a = val, .b = -val, .c = val * 2};
+}
+
+TestCase {
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        values[idx] = (int64_t)idx * 3;
+        envs[idx] = values + idx;
+        aggRets[idx] = idx % 3 == 0;
+        fcns[idx] = (aggRets[idx]) ? (void*)CallbackAgg : (void*)CallbackNorm;
+    }
+
+    CClosureNewBatch(fcns, envs, aggRets, closures, NUM_CLOSURES);
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        AssertBoolEqual(CClosureCheck(closures[idx]), true);
+        AssertIs(CClosureGetFcn(closures[idx]), fcns[idx]);
+        AssertIs(CClosureGetEnv(closures[idx]), envs[idx]);
+        if (aggRets[idx]) {
+            Doohickey result = ((Doohickey(*)(void))closures[idx])();
+            AssertIntEqual(result.a, values[idx]);
+            AssertIntEqual(result.b, -values[idx]);
+            AssertIntEqual(result.c, values[idx] * 2);
+        } else {
+            AssertIntEqual(((int64_t(*)(void))closures[idx])(), values[idx]);
+        }
+    }
+
+    CClosureFreeBatch(closures, envsOut, NUM_CLOSURES);
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        AssertBoolEqual(CClosureCheck(closures[idx]), false);
+        AssertIs(envsOut[idx], envs[idx]);
+    }
+
+    CClosureNewBatch(fcns, NULL, NULL, closures, NUM_CLOSURES);
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        AssertBoolEqual(CClosureCheck(closures[idx]), true);
+        AssertIs(CClosureGetEnv(closures[idx]), NULL);
+    }
+    CClosureFreeBatch(closures, NULL, NUM_CLOSURES);
+
+    Pass();
+}
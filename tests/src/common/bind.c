@@ -0,0 +1,129 @@
+/* Verify that closures created using CClosureBind receive their bound values
+ * as leading arguments followed by every argument they were called with. */
+
+#include "test_prelude.h"
+
+static int64_t CallbackCtx(CClosureCtx ctx, int64_t a) {
+    return *(int64_t*)ctx.env - a;
+}
+
+static int64_t CallbackPeek(uint64_t a, uint64_t b, uint64_t c) {
+    return (int64_t)(a + b + c);
+}
+
+typedef struct SelfFree {
+    void* self;
+    void* reused;
+} SelfFree;
+
+static int64_t CallbackSelfFree(CClosureCtx ctx, int64_t a) {
+    /* Free this closure and take its slot back as a bound closure before
+     * returning through it. */
+    SelfFree* state = ctx.env;
+    uintptr_t values[] = {1, 2, 3};
+    CClosureFree(state->self);
+    for (size_t idx = 0; idx < 1024 && state->reused != state->self; idx++) {
+        if (state->reused != NULL)
+            CClosureFree(state->reused);
+        state->reused = CClosureBind(CallbackPeek, 3, values);
+    }
+
+    return a * 2;
+}
+
+static int64_t Callback1(int64_t id,
+                         int64_t a,
+                         int64_t b,
+                         double x,
+                         int64_t c,
+                         int64_t d,
+                         int64_t e) {
+    return id + a * 10 + b * 100 + c * 1000 + d * 10000 + e * 100000 +
+           (int64_t)x;
+}
+
+static int64_t Callback2(int64_t id,
+                         uint64_t mask,
+                         int64_t a,
+                         double x,
+                         int64_t b,
+                         int64_t c,
+                         int64_t d) {
+    return (int64_t)(mask & 0xff) + id * 10 + a * 100 + b * 1000 + c * 10000 +
+           d * 100000 + (int64_t)x;
+}
+
+static int64_t Callback3(int64_t id,
+                         uint64_t mask,
+                         const int64_t* ptr,
+                         int64_t a,
+                         double x,
+                         int64_t b,
+                         int64_t c,
+                         double y) {
+    return (int64_t)(mask >> 56) + id * 10 + *ptr * 100 + a * 1000 +
+           b * 10000 + c * 100000 + (int64_t)(x * y);
+}
+
+TestCase {
+    int64_t env = 7;
+    uintptr_t values[] = {3, 0x0500000000000004, (uintptr_t)&env};
+
+    AssertIs(CClosureBind(Callback1, 0, values), NULL);
+    AssertIs(CClosureBind(Callback3, CCLOSURE_MAX_BIND_ARGS + 1, values), NULL);
+#ifdef __x86_64__
+    int64_t (*clos1)(int64_t, int64_t, double, int64_t, int64_t, int64_t) =
+        CClosureBind(Callback1, 1, values);
+    int64_t (*clos2)(int64_t, double, int64_t, int64_t, int64_t) =
+        CClosureBind(Callback2, 2, values);
+    int64_t (*clos3)(int64_t, double, int64_t, int64_t, double) =
+        CClosureBind(Callback3, 3, values);
+
+    AssertBoolEqual(CClosureCheck(clos1), true);
+    AssertBoolEqual(CClosureCheck(clos2), true);
+    AssertBoolEqual(CClosureCheck(clos3), true);
+    AssertIs(CClosureGetFcn(clos3), Callback3);
+    AssertIs(CClosureGetEnv(clos3), (void*)3);
+
+    AssertIntEqual(clos1(1, 2, 9.0, 3, 4, 5), (int64_t)543222);
+    AssertIntEqual(clos2(1, 9.0, 2, 3, 4), (int64_t)432143);
+    AssertIntEqual(clos3(1, 2.0, 2, 3, 4.0), (int64_t)321743);
+
+    /* Only the first value can be rebound. */
+    AssertIs(CClosureSetEnv(clos3, (void*)6), (void*)3);
+    AssertIntEqual(clos3(1, 2.0, 2, 3, 4.0), (int64_t)321773);
+    AssertIs(CClosureSetEnv(clos2, (void*)6), (void*)3);
+    AssertIntEqual(clos2(1, 9.0, 2, 3, 4), (int64_t)432173);
+
+    AssertIs(CClosureFree(clos1), (void*)3);
+    AssertIs(CClosureFree(clos2), (void*)6);
+    AssertIs(CClosureFree(clos3), (void*)6);
+    AssertBoolEqual(CClosureCheck(clos3), false);
+
+    /* Freed slots must work as ordinary closures again. Slots are only reused
+     * once it is safe to do so, so keep churning until it comes back. */
+    int64_t (*clos)(int64_t) = NULL;
+    for (size_t idx = 0; idx < 1024 && (void*)clos != (void*)clos3; idx++) {
+        if (clos != NULL)
+            CClosureFree(clos);
+        clos = CClosureNew(CallbackCtx, &env, false);
+        AssertIntEqual(clos(3), (int64_t)4);
+    }
+    AssertIs(clos, clos3);
+    CClosureFree(clos);
+
+    /* The other way around, a closure that frees itself must still return if
+     * its slot is reused by a bound closure before it does. */
+    SelfFree state = {NULL, NULL};
+    clos = CClosureNew(CallbackSelfFree, &state, false);
+    state.self = clos;
+    AssertIntEqual(clos(21), (int64_t)42);
+    AssertIs(state.reused, state.self);
+    AssertIntEqual(((int64_t(*)(void))state.reused)(), (int64_t)6);
+    CClosureFree(state.reused);
+#else
+    AssertIs(CClosureBind(Callback1, 1, values), NULL);
+#endif
+
+    Pass();
+}
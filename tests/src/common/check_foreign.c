@@ -0,0 +1,40 @@
+/* Verify that CClosureCheck rejects references that do not point into any
+ * closure block or into the middle of a closure, even while many blocks
+ * exist. */
+
+#include "test_prelude.h"
+
+#define NUM_CLOSURES ((size_t)100000)
+static void* closures[NUM_CLOSURES] = {0};
+
+static void Callback(CClosureCtx ctx) {
+    (void)ctx;
+
+    return;
+}
+
+TestCase {
+    int32_t local = 0;
+    int32_t* heap = malloc(sizeof(int32_t));
+
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++)
+        closures[idx] = CClosureNew(Callback, NULL, false);
+
+    AssertBoolEqual(CClosureCheck(&local), false);
+    AssertBoolEqual(CClosureCheck(heap), false);
+    AssertBoolEqual(CClosureCheck(Callback), false);
+    AssertBoolEqual(CClosureCheck(closures), false);
+    AssertBoolEqual(CClosureCheck((void*)UINTPTR_MAX), false);
+    for (size_t offset = 1; offset < 16; offset++)
+        AssertBoolEqual(CClosureCheck((uint8_t*)closures[0] + offset), false);
+
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        AssertBoolEqual(CClosureCheck(closures[idx]), true);
+        CClosureFree(closures[idx]);
+        AssertBoolEqual(CClosureCheck(closures[idx]), false);
+    }
+
+    free(heap);
+
+    Pass();
+}
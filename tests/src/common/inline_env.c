@@ -0,0 +1,45 @@
+/* Verify that closures created using CClosureNewInline keep their own copy of
+ * their environment. */
+
+#include "test_prelude.h"
+
+typedef struct Counter {
+    int64_t count;
+    int64_t step;
+    int64_t limit;
+} Counter;
+
+#define NUM_CLOSURES ((size_t)10000)
+static int64_t (*closures[NUM_CLOSURES])(void) = {0};
+
+static int64_t Callback(CClosureCtx ctx) {
+    Counter* env = ctx.env;
+    if (env->count < env->limit)
+        env->count += env->step;
+
+    return env->count;
+}
+
+TestCase {
+    uint8_t big[CCLOSURE_MAX_INLINE_ENV + 1] = {0};
+    AssertIs(CClosureNewInline(Callback, big, sizeof(big), false), NULL);
+
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        Counter env = {.count = 0, .step = (int64_t)idx, .limit = 2 * idx};
+        closures[idx] = CClosureNewInline(Callback, &env, sizeof(env), false);
+        AssertBoolEqual(CClosureCheck(closures[idx]), true);
+        AssertBoolEqual(CClosureGetEnv(closures[idx]) != &env, true);
+        AssertIntEqual((uint64_t)CClosureGetEnv(closures[idx]) % 16,
+                       (uint64_t)0);
+    }
+    for (size_t round = 1; round <= 3; round++) {
+        for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+            int64_t expected = (int64_t)((round < 2) ? round : 2) * idx;
+            AssertIntEqual(closures[idx](), expected);
+        }
+    }
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++)
+        CClosureFree(closures[idx]);
+
+    Pass();
+}
@@ -0,0 +1,48 @@
+/* Verify that a pool reuses the slots of closures freed individually, most
+ * recently freed first, and that destroying the pool destroys the closures
+ * still live in it. */
+
+#include "test_prelude.h"
+
+#define NUM_CLOSURES ((size_t)8)
+static void* closures[NUM_CLOSURES] = {0};
+
+static int64_t Callback(CClosureCtx ctx, int64_t val) {
+    return (int64_t)(intptr_t)ctx.env + val;
+}
+
+TestCase {
+    CClosureStats before;
+    CClosureGetStats(&before);
+
+    CClosurePool* pool = CClosurePoolCreate();
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++)
+        closures[idx] = CClosurePoolNew(pool, Callback, (void*)(intptr_t)idx,
+                                        false);
+
+    /* Freed slots come straight back, the last one freed first. */
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx += 2)
+        AssertIs(CClosurePoolFree(pool, closures[idx]), (void*)(intptr_t)idx);
+    for (size_t idx = NUM_CLOSURES; idx > 0; idx -= 2) {
+        void* clos = CClosurePoolNew(pool, Callback, (void*)(intptr_t)-1, false);
+        AssertIs(clos, closures[idx - 2]);
+        AssertIntEqual(((int64_t(*)(int64_t))clos)(3), (int64_t)2);
+    }
+
+    CClosureStats during;
+    CClosureGetStats(&during);
+    AssertIntEqual((uint64_t)during.liveClosures,
+                   (uint64_t)(before.liveClosures + NUM_CLOSURES));
+
+    /* Every closure is still live when the pool goes. */
+    CClosurePoolDestroy(pool);
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++)
+        AssertBoolEqual(CClosureCheck(closures[idx]), false);
+
+    CClosureStats after;
+    CClosureGetStats(&after);
+    AssertIntEqual((uint64_t)after.liveClosures,
+                   (uint64_t)before.liveClosures);
+
+    Pass();
+}
@@ -0,0 +1,60 @@
+/* Verify that closures can be rebound to a new function and environment. */
+
+#include "test_prelude.h"
+
+typedef struct Doohickey {
+    int64_t a;
+    int64_t b;
+    int64_t c;
+} Doohickey;
+
+static int32_t CallbackAdd(CClosureCtx ctx, int32_t val) {
+    return *(int32_t*)ctx.env + val;
+}
+
+static int32_t CallbackMul(CClosureCtx ctx, int32_t val) {
+    return *(int32_t*)ctx.env * val;
+}
+
+static Doohickey CallbackAgg(CClosureCtx ctx) {
+    int64_t val = *(int32_t*)ctx.env;
+
+    return (Doohickey){.a = val, .b = -val, .c = val * 2};
+}
+
+static int32_t CallbackArgs(void* env, int32_t val) {
+    return *(int32_t*)env - val;
+}
+
+TestCase {
+    int32_t env0 = 3;
+    int32_t env1 = 5;
+
+    int32_t (*clos0)(int32_t) = CClosureNew(CallbackAdd, &env0, false);
+    AssertIntEqual(clos0(2), (int32_t)5);
+    AssertIs(CClosureSetEnv(clos0, &env1), &env0);
+    AssertIs(CClosureGetEnv(clos0), &env1);
+    AssertIntEqual(clos0(2), (int32_t)7);
+    AssertIs(CClosureSetFcn(clos0, CallbackMul), CallbackAdd);
+    AssertIs(CClosureGetFcn(clos0), CallbackMul);
+    AssertIntEqual(clos0(2), (int32_t)10);
+    AssertBoolEqual(CClosureCheck(clos0), true);
+    AssertIs(CClosureFree(clos0), &env1);
+
+    Doohickey (*clos1)(void) = CClosureNew(CallbackAgg, &env0, true);
+    AssertIntEqual(clos1().c, (int64_t)6);
+    AssertIs(CClosureSetEnv(clos1, &env1), &env0);
+    AssertIntEqual(clos1().c, (int64_t)10);
+    CClosureFree(clos1);
+
+    int32_t (*clos2)(int32_t) = CClosureNewArgs(CallbackArgs, &env0, 1);
+    if (clos2 != NULL) {
+        AssertIntEqual(clos2(1), (int32_t)2);
+        AssertIs(CClosureSetEnv(clos2, &env1), &env0);
+        AssertIntEqual(clos2(1), (int32_t)4);
+        AssertIs(CClosureGetEnv(clos2), &env1);
+        CClosureFree(clos2);
+    }
+
+    Pass();
+}
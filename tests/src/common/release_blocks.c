@@ -0,0 +1,60 @@
+/* Verify that memory backing freed closures is given back to the kernel, and
+ * that the released blocks can be used again afterwards. */
+
+#include <unistd.h>
+
+#include "test_prelude.h"
+
+#define NUM_CLOSURES ((size_t)1000000)
+static int32_t (*closures[NUM_CLOSURES])(void) = {0};
+
+static int32_t Callback(CClosureCtx ctx) {
+    return (int32_t)(intptr_t)ctx.env;
+}
+
+static size_t ResidentPages(void) {
+    /* File backed pages are left out, as those may be trampolines mapped
+     * straight from the library and are reclaimable regardless. */
+    size_t size = 0;
+    size_t resident = 0;
+    size_t shared = 0;
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL ||
+        fscanf(statm, "%zu %zu %zu", &size, &resident, &shared) != 3)
+        Fail("Could not read /proc/self/statm!\n");
+    fclose(statm);
+
+    return resident - shared;
+}
+
+static void CreateClosures(void) {
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        closures[idx] = CClosureNew(Callback, (void*)(intptr_t)idx, false);
+        AssertIntEqual(closures[idx](), (int32_t)idx);
+    }
+
+    return;
+}
+
+static void FreeClosures(void) {
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        CClosureFree(closures[idx]);
+        AssertBoolEqual(CClosureCheck(closures[idx]), false);
+    }
+
+    return;
+}
+
+TestCase {
+    size_t base = ResidentPages();
+    CreateClosures();
+    uint64_t limit = base + (ResidentPages() - base) / 2;
+    FreeClosures();
+    AssertIntLess((uint64_t)ResidentPages(), limit);
+
+    CreateClosures();
+    FreeClosures();
+    AssertIntLess((uint64_t)ResidentPages(), limit);
+
+    Pass();
+}
@@ -0,0 +1,52 @@
+/* Verify that CClosureReserve grows the pool up front, so that creating the
+ * reserved number of closures never has to, that reserved blocks survive
+ * their closures being destroyed, and that impossible reservations are
+ * refused. */
+
+#include "test_prelude.h"
+
+#define NUM_CLOSURES ((size_t)100000)
+static void* closures[NUM_CLOSURES] = {0};
+
+static int32_t Callback(CClosureCtx ctx) {
+    return (int32_t)(intptr_t)ctx.env;
+}
+
+TestCase {
+    CClosureStats before;
+    CClosureGetStats(&before);
+
+    AssertBoolEqual(CClosureReserve(NUM_CLOSURES), true);
+    CClosureStats reserved;
+    CClosureGetStats(&reserved);
+    AssertIntGreater(reserved.numGrows, before.numGrows);
+
+    /* Reserving what already exists is free. */
+    CClosureReserve(NUM_CLOSURES);
+    CClosureStats again;
+    CClosureGetStats(&again);
+    AssertIntEqual(again.numGrows, reserved.numGrows);
+
+    /* Reservations that could never fit are refused without growing. */
+    AssertBoolEqual(CClosureReserve(SIZE_MAX), false);
+    CClosureGetStats(&again);
+    AssertIntEqual(again.numGrows, reserved.numGrows);
+
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        closures[idx] = CClosureNew(Callback, (void*)(intptr_t)idx, false);
+        AssertIntEqual(((int32_t(*)(void))closures[idx])(), (int32_t)idx);
+    }
+    CClosureStats during;
+    CClosureGetStats(&during);
+    AssertIntEqual(during.numGrows, reserved.numGrows);
+
+    CClosureFreeBatch(closures, NULL, NUM_CLOSURES);
+    CClosureStats after;
+    CClosureGetStats(&after);
+    AssertIntEqual((uint64_t)after.committedBlocks,
+                   (uint64_t)reserved.committedBlocks);
+
+    CClosureReserve(0);
+
+    Pass();
+}
@@ -0,0 +1,44 @@
+/* Verify that CClosureGetStats tracks created and freed closures and the
+ * memory blocks backing them. */
+
+#include "test_prelude.h"
+
+#define NUM_CLOSURES ((size_t)100000)
+static void* closures[NUM_CLOSURES] = {0};
+
+static int32_t Callback(CClosureCtx ctx) {
+    return (int32_t)(intptr_t)ctx.env;
+}
+
+TestCase {
+    CClosureStats before;
+    CClosureGetStats(&before);
+    /* Nothing is mapped until the first closure is created. */
+    AssertIntEqual((uint64_t)before.numBlocks, (uint64_t)0);
+    AssertIntEqual((uint64_t)before.mappedBytes, (uint64_t)0);
+
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++)
+        closures[idx] = CClosureNew(Callback, NULL, false);
+
+    CClosureStats during;
+    CClosureGetStats(&during);
+    AssertIntEqual((uint64_t)during.liveClosures,
+                   (uint64_t)(before.liveClosures + NUM_CLOSURES));
+    AssertIntEqual(during.numCreated, before.numCreated + NUM_CLOSURES);
+    AssertIntGreater((uint64_t)during.numBlocks, (uint64_t)before.numBlocks);
+    AssertIntGreater(during.numGrows, before.numGrows);
+    AssertIntLess((uint64_t)during.committedBytes,
+                  (uint64_t)during.mappedBytes + 1);
+
+    CClosureFreeBatch(closures, NULL, NUM_CLOSURES);
+
+    CClosureStats after;
+    CClosureGetStats(&after);
+    AssertIntEqual((uint64_t)after.liveClosures,
+                   (uint64_t)before.liveClosures);
+    AssertIntEqual(after.numFreed, before.numFreed + NUM_CLOSURES);
+    AssertIntLess((uint64_t)after.committedBlocks,
+                  (uint64_t)during.committedBlocks);
+
+    Pass();
+}
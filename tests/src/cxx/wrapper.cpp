@@ -0,0 +1,109 @@
+/* Verify that the C++ wrapper binds lambdas and member functions, picks the
+ * aggregate thunk on its own, and hands closures over when moved. */
+
+#include <memory>
+#include <vector>
+
+#include "cclosure.hpp"
+#include "test_prelude.h"
+
+struct Doohickey {
+    int64_t a;
+    int64_t b;
+    int64_t c;
+};
+
+struct Counter {
+    int64_t count;
+
+    int64_t Add(int64_t val) { return count += val; }
+    int64_t Get() const { return count; }
+};
+
+static size_t numDestroyed = 0;
+
+struct Tracked {
+    int64_t val;
+
+    explicit Tracked(int64_t val) : val(val) {}
+    Tracked(const Tracked& other) = default;
+    ~Tracked() { numDestroyed++; }
+};
+
+static int64_t CallThrough(int64_t (*fcn)(int64_t), int64_t val) {
+    return fcn(val);
+}
+
+TestCase {
+    /* Small state is stored inline, large state on the heap. */
+    int64_t offset = 5;
+    cclosure::closure<int64_t(int64_t)> add(
+        [offset](int64_t val) { return val + offset; });
+    AssertBoolEqual(CClosureCheck((void*)add.get()), true);
+    AssertBoolEqual(CallThrough(add.get(), 2) == 7, true);
+
+    std::vector<int64_t> big(8, 3);
+    cclosure::closure<int64_t(int64_t)> sum([big](int64_t val) {
+        int64_t total = val;
+        for (int64_t elem : big)
+            total += elem;
+        return total;
+    });
+    cclosure::closure<int64_t(int64_t)> unique(
+        [ptr = std::make_unique<int64_t>(10)](int64_t val) {
+            return *ptr * val;
+        });
+    AssertBoolEqual(sum(1) == 25, true);
+    AssertBoolEqual(unique(4) == 40, true);
+
+    /* Aggregate returns need no flag. */
+    cclosure::closure<Doohickey(int64_t)> agg([offset](int64_t val) {
+        return Doohickey{val, -val, val + offset};
+    });
+    AssertBoolEqual(agg(3).c == 8, true);
+    AssertBoolEqual(agg.get()(4).b == -4, true);
+
+    /* Member functions. */
+    Counter counter = {0};
+    cclosure::closure<int64_t(int64_t)> bump(counter, &Counter::Add);
+    cclosure::closure<int64_t()> peek(counter, &Counter::Get);
+    bump(3);
+    bump(4);
+    AssertBoolEqual(peek() == 7, true);
+
+    /* Moving hands the same closure over and leaves the source empty. */
+    int64_t (*raw)(int64_t) = add.get();
+    cclosure::closure<int64_t(int64_t)> moved(std::move(add));
+    AssertBoolEqual(static_cast<bool>(add), false);
+    AssertBoolEqual(moved.get() == raw, true);
+    AssertBoolEqual(moved(1) == 6, true);
+
+    std::vector<cclosure::closure<int64_t(int64_t)>> callbacks;
+    for (int64_t idx = 0; idx < 100; idx++)
+        callbacks.emplace_back([idx](int64_t val) { return val * idx; });
+    raw = callbacks[42].get();
+    callbacks.reserve(1000);
+    AssertBoolEqual(callbacks[42].get() == raw, true);
+    AssertBoolEqual(raw(2) == 84, true);
+
+    moved = std::move(callbacks[42]);
+    AssertBoolEqual(CClosureCheck((void*)raw), true);
+    AssertBoolEqual(moved.get() == raw, true);
+    callbacks.clear();
+
+    /* Bound state is destroyed exactly once, along with its closure. */
+    {
+        cclosure::closure<int64_t()> tracked(
+            [state = Tracked(9)]() { return state.val; });
+        cclosure::closure<int64_t()> owner(std::move(tracked));
+        size_t before = numDestroyed;
+        AssertBoolEqual(owner() == 9, true);
+        void* clos = (void*)owner.get();
+        owner.reset();
+        AssertBoolEqual(numDestroyed == before + 1, true);
+        AssertBoolEqual(CClosureCheck(clos), false);
+        AssertBoolEqual(static_cast<bool>(owner), false);
+    }
+
+    Pass();
+}
@@ -0,0 +1,81 @@
+/* Verify that closures created on one thread can be freed on another, and that
+ * slots cached by exiting threads are handed back for reuse. */
+
+#include <pthread.h>
+
+#include "test_prelude.h"
+
+#define NUM_THREADS ((size_t)8)
+#define NUM_CLOSURES ((size_t)50000)
+static int32_t (*closures[NUM_THREADS][NUM_CLOSURES])(void) = {0};
+static int32_t envs[NUM_THREADS][NUM_CLOSURES] = {0};
+static pthread_barrier_t barrier;
+
+static int32_t Callback(CClosureCtx ctx) {
+    return *(int32_t*)ctx.env;
+}
+
+static void CreateClosures(size_t thread) {
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        envs[thread][idx] = (int32_t)(thread * NUM_CLOSURES + idx);
+        closures[thread][idx] =
+            CClosureNew(Callback, &envs[thread][idx], false);
+        AssertBoolEqual(CClosureCheck(closures[thread][idx]), true);
+    }
+
+    return;
+}
+
+static void CallClosures(size_t thread) {
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++)
+        AssertIntEqual(closures[thread][idx](),
+                       (int32_t)(thread * NUM_CLOSURES + idx));
+
+    return;
+}
+
+static void* ThreadChurn(void* ctx) {
+    size_t thread = (size_t)ctx;
+    size_t neighbor = (thread + 1) % NUM_THREADS;
+
+    CreateClosures(thread);
+    CallClosures(thread);
+    pthread_barrier_wait(&barrier);
+
+    CallClosures(neighbor);
+    pthread_barrier_wait(&barrier);
+
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++)
+        AssertIs(CClosureFree(closures[neighbor][idx]),
+                 &envs[neighbor][idx]);
+    pthread_barrier_wait(&barrier);
+
+    CreateClosures(thread);
+    CallClosures(thread);
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx += 2)
+        CClosureFree(closures[thread][idx]);
+
+    return ctx;
+}
+
+TestCase {
+    pthread_t threads[NUM_THREADS] = {0};
+
+    pthread_barrier_init(&barrier, NULL, NUM_THREADS);
+    for (size_t idx = 0; idx < NUM_THREADS; idx++)
+        pthread_create(threads + idx, NULL, ThreadChurn, (void*)idx);
+    for (size_t idx = 0; idx < NUM_THREADS; idx++)
+        pthread_join(threads[idx], NULL);
+    pthread_barrier_destroy(&barrier);
+
+    for (size_t thread = 0; thread < NUM_THREADS; thread++) {
+        for (size_t idx = 1; idx < NUM_CLOSURES; idx += 2) {
+            AssertIntEqual(closures[thread][idx](),
+                           (int32_t)(thread * NUM_CLOSURES + idx));
+            CClosureFree(closures[thread][idx]);
+            AssertBoolEqual(CClosureCheck(closures[thread][idx]), false);
+        }
+    }
+
+    Pass();
+}
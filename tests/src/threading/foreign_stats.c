@@ -0,0 +1,45 @@
+/* Verify that CClosureGetStats counts closures created by a thread that only
+ * ever used an arena handed to it by another thread. */
+
+#include <pthread.h>
+
+#include "test_prelude.h"
+
+#define NUM_CLOSURES ((size_t)1000)
+
+static int32_t Callback(CClosureCtx ctx) {
+    return (int32_t)(intptr_t)ctx.env;
+}
+
+static void* ThreadUseArena(void* ctx) {
+    CClosureArena* arena = ctx;
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++)
+        CClosureArenaNew(arena, Callback, NULL, false);
+
+    return ctx;
+}
+
+TestCase {
+    /* Arenas may move between threads as long as only one uses them at a
+     * time, unlike pools. */
+    CClosureArena* arena = CClosureArenaCreate();
+    CClosureStats before;
+    CClosureGetStats(&before);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, ThreadUseArena, arena);
+    pthread_join(thread, NULL);
+
+    CClosureStats after;
+    CClosureGetStats(&after);
+    AssertIntEqual(after.numCreated, before.numCreated + NUM_CLOSURES);
+    AssertIntEqual((uint64_t)after.liveClosures,
+                   (uint64_t)(before.liveClosures + NUM_CLOSURES));
+
+    CClosureArenaDestroy(arena);
+    CClosureGetStats(&after);
+    AssertIntEqual((uint64_t)after.liveClosures,
+                   (uint64_t)before.liveClosures);
+
+    Pass();
+}
@@ -0,0 +1,70 @@
+/* Verify that threads querying closures while other threads free and recreate
+ * them always see an environment the closure was actually bound to. */
+
+#include <pthread.h>
+
+#include "test_prelude.h"
+
+#define NUM_CLOSURES ((size_t)64)
+#define NUM_ROUNDS ((size_t)20000)
+
+static int32_t envs[2] = {17, 42};
+static void* volatile closures[NUM_CLOSURES] = {0};
+static volatile bool done = false;
+
+static int32_t Callback(CClosureCtx ctx) {
+    return *(int32_t*)ctx.env;
+}
+
+static void* ThreadQueryClosures(void* ctx) {
+    for (size_t idx = 0; !done; idx++) {
+        /* A query that only starts once its closure is long gone may find
+         * the slot reused, or its block given back, which reads as zeroes.
+         * It must never see anything else. */
+        void* closure = closures[idx % NUM_CLOSURES];
+        void* env = CClosureGetEnv(closure);
+        if (env != envs && env != envs + 1 && env != NULL)
+            Fail("Foreign environment %p!\n", env);
+        void* fcn = CClosureGetFcn(closure);
+        if (fcn != Callback && fcn != NULL)
+            Fail("Foreign callback %p!\n", fcn);
+    }
+
+    return ctx;
+}
+
+static void* ThreadChurnClosures(void* ctx) {
+    int32_t* env = ctx;
+    for (size_t round = 0; round < NUM_ROUNDS; round++) {
+        size_t idx = round % NUM_CLOSURES;
+        void* closure = CClosureNew(Callback, env, false);
+        void* old = __atomic_exchange_n(closures + idx, closure,
+                                        __ATOMIC_ACQ_REL);
+        CClosureFree(old);
+    }
+
+    return ctx;
+}
+
+TestCase {
+    pthread_t queriers[2] = {0};
+    pthread_t churners[2] = {0};
+
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++)
+        closures[idx] = CClosureNew(Callback, envs, false);
+
+    for (size_t idx = 0; idx < 2; idx++)
+        pthread_create(queriers + idx, NULL, ThreadQueryClosures, NULL);
+    for (size_t idx = 0; idx < 2; idx++)
+        pthread_create(churners + idx, NULL, ThreadChurnClosures, envs + idx);
+    for (size_t idx = 0; idx < 2; idx++)
+        pthread_join(churners[idx], NULL);
+    done = true;
+    for (size_t idx = 0; idx < 2; idx++)
+        pthread_join(queriers[idx], NULL);
+
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++)
+        CClosureFree(closures[idx]);
+
+    Pass();
+}
@@ -0,0 +1,52 @@
+/* Verify that threads calling a closure while another thread rebinds it always
+ * see either the old or the new environment. */
+
+#include <pthread.h>
+
+#include "test_prelude.h"
+
+#define NUM_CALLS ((size_t)1000000)
+
+static int32_t envs[2] = {17, 42};
+static volatile bool done = false;
+
+static int32_t Callback(CClosureCtx ctx) {
+    return *(int32_t*)ctx.env;
+}
+
+static void* ThreadCallClosure(void* ctx) {
+    int32_t (*closure)(void) = ctx;
+    for (size_t idx = 0; idx < NUM_CALLS; idx++) {
+        int32_t result = closure();
+        if (result != envs[0] && result != envs[1])
+            Fail("Torn environment %i!\n", result);
+    }
+
+    return ctx;
+}
+
+static void* ThreadRebindClosure(void* ctx) {
+    for (size_t idx = 0; !done; idx++)
+        CClosureSetEnv(ctx, envs + idx % 2);
+
+    return ctx;
+}
+
+TestCase {
+    pthread_t callers[2] = {0};
+    pthread_t rebinder = {0};
+
+    void* closure = CClosureNew(Callback, envs, false);
+
+    pthread_create(&rebinder, NULL, ThreadRebindClosure, closure);
+    for (size_t idx = 0; idx < 2; idx++)
+        pthread_create(callers + idx, NULL, ThreadCallClosure, closure);
+    for (size_t idx = 0; idx < 2; idx++)
+        pthread_join(callers[idx], NULL);
+    done = true;
+    pthread_join(rebinder, NULL);
+
+    CClosureFree(closure);
+
+    Pass();
+}
@@ -0,0 +1,51 @@
+/* Verify that blocks given back to the kernel while other threads are still
+ * releasing slots into them never hand out a slot twice. */
+
+#include <pthread.h>
+
+#include "test_prelude.h"
+
+#define NUM_THREADS ((size_t)4)
+#define NUM_CLOSURES ((size_t)2000)
+#define NUM_ROUNDS ((size_t)200)
+static void* closures[NUM_THREADS][NUM_CLOSURES] = {0};
+static int32_t envs[NUM_THREADS][NUM_CLOSURES] = {0};
+static pthread_barrier_t barrier;
+
+static int32_t Callback(CClosureCtx ctx) {
+    return *(int32_t*)ctx.env;
+}
+
+static void* ThreadChurn(void* ctx) {
+    size_t thread = (size_t)ctx;
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++) {
+        envs[thread][idx] = (int32_t)(thread * NUM_CLOSURES + idx);
+        closures[thread][idx] = CClosureNew(Callback, &envs[thread][idx], false);
+    }
+    pthread_barrier_wait(&barrier);
+    for (size_t idx = 0; idx < NUM_CLOSURES; idx++)
+        AssertIntEqual(((int32_t(*)(void))closures[thread][idx])(),
+                       (int32_t)(thread * NUM_CLOSURES + idx));
+    pthread_barrier_wait(&barrier);
+
+    /* Every thread empties its blocks and flushes its magazine at once, so
+     * that trims race with releases into the very blocks being trimmed. */
+    CClosureFreeBatch(closures[thread], NULL, NUM_CLOSURES);
+
+    return ctx;
+}
+
+TestCase {
+    pthread_t threads[NUM_THREADS] = {0};
+
+    pthread_barrier_init(&barrier, NULL, NUM_THREADS);
+    for (size_t round = 0; round < NUM_ROUNDS; round++) {
+        for (size_t idx = 0; idx < NUM_THREADS; idx++)
+            pthread_create(threads + idx, NULL, ThreadChurn, (void*)idx);
+        for (size_t idx = 0; idx < NUM_THREADS; idx++)
+            pthread_join(threads[idx], NULL);
+    }
+    pthread_barrier_destroy(&barrier);
+
+    Pass();
+}